@@ -10,7 +10,9 @@
 #include "esp_log.h"
 
 #include "client.h"
+#include "iobuf.h"
 #include "storage.h"
+#include "rtc.h"
 #include "credentials.h"
 
 #include <netdb.h>
@@ -49,9 +51,18 @@ static int s_server_index = 0;
  */
 static int s_socket = -1;
 
-static char big_rcv_buf [1024];
-
-static char big_snd_buf [512];
+/**
+ * Set when network work was cancelled.
+ */
+static volatile int s_aborted = 0;
+/**
+ * Wall time when first byte of response arrived [ms], 0 - none yet.
+ */
+static int64_t s_response_ms = 0;
+/**
+ * Connection holds I/O buffer arena.
+ */
+static int s_iobuf_open = 0;
 
 /**
  * (Re)init tokenizer buffer.
@@ -133,6 +144,22 @@ int client_open(void)
         return -1;
     }
 
+    if (s_aborted)
+    {
+        return -3;
+    }
+
+    /* request and response buffers, arena may be already open
+     * and bigger (OTA) */
+    if (!s_iobuf_open)
+    {
+        if (iobuf_open(CLIENT_IOBUF_SIZE))
+        {
+            return -4;
+        }
+        s_iobuf_open = 1;
+    }
+
     // get server address (it might've changed since last call)
     init_addresses();
 
@@ -175,11 +202,23 @@ int client_open(void)
         break;
     }
 
+    if (result)
+    {
+        iobuf_close();
+        s_iobuf_open = 0;
+    }
     return result;
 }
 
 int client_close(void)
 {
+    /* socket might have been closed on error already */
+    if (s_iobuf_open)
+    {
+        iobuf_close();
+        s_iobuf_open = 0;
+    }
+
     if (s_socket < 0)
     {
         return -1;
@@ -191,7 +230,25 @@ int client_close(void)
     return 0;
 }
 
-int client_request(const char * request, int length)
+void client_abort(void)
+{
+    int sock = s_socket;
+
+    s_aborted = 1;
+
+    if (sock >= 0)
+    {
+        /* wakes up blocked connect/read/write,
+         * socket is closed by its owner */
+        shutdown(sock, SHUT_RDWR);
+        ESP_LOGW(TAG, "connection aborted");
+    }
+}
+
+/**
+ * Send request and set receive timeout.
+ */
+static int request_send(const char * request, int length)
 {
     struct timeval receiving_timeout;
 
@@ -200,6 +257,8 @@ int client_request(const char * request, int length)
         return -1;
     }
 
+    s_response_ms = 0;
+
     if (write(s_socket, request, length) < 0)
     {
         ESP_LOGE(TAG, "... socket send failed");
@@ -222,20 +281,39 @@ int client_request(const char * request, int length)
     return 0;
 }
 
+int client_request(const char * request, int length)
+{
+    int r = request_send(request, length);
+
+    /* request is not needed anymore, its space goes to response */
+    iobuf_release(IOBUF_REQUEST, (void *) request);
+    return r;
+}
+
+int64_t client_response_time_ms(void)
+{
+    return s_response_ms;
+}
+
 int client_response(void)
 {
     int r;
-    char recv_buf[64];
+    char * recv_buf = iobuf_lease(IOBUF_RESPONSE, CLIENT_RESPONSE_SIZE);
+
+    if (NULL == recv_buf)
+    {
+        return 0;
+    }
 
     /* Read HTTP response */
     do {
-        bzero(recv_buf, sizeof(recv_buf));
-        r = read(s_socket, recv_buf, sizeof(recv_buf)-1);
+        r = read(s_socket, recv_buf, CLIENT_RESPONSE_SIZE);
         for(int i = 0; i < r; i++) {
             putchar(recv_buf[i]);
         }
     } while (r > 0);
 
+    iobuf_release(IOBUF_RESPONSE, recv_buf);
     return r == 0;
 }
 
@@ -244,25 +322,35 @@ int client_response(void)
 int client_response_hdl(response_buf_handler handler)
 {
     int r;
+    char * recv_buf = iobuf_lease(IOBUF_RESPONSE, CLIENT_RESPONSE_SIZE);
+
+    if (NULL == recv_buf)
+    {
+        return 0;
+    }
 
     /* Read HTTP response */
     do {
-        bzero(big_rcv_buf, sizeof(big_rcv_buf));
-        r = read(s_socket, big_rcv_buf, sizeof(big_rcv_buf)-1);
-        if (0 != handler(big_rcv_buf, r))
+        r = read(s_socket, recv_buf, CLIENT_RESPONSE_SIZE - 1);
+        /* only terminate data, handler gets length */
+        recv_buf[(r > 0) ? r : 0] = 0;
+        if (0 != handler(recv_buf, r))
         {
             r = -1;
         }
     }
     while (r > 0);
 
+    iobuf_release(IOBUF_RESPONSE, recv_buf);
     return r == 0;
 }
 
-int client_response_iterate(reponse_handler handler)
+/**
+ * Read response into buffer and pass key+value commands to handler.
+ */
+static int response_iterate(char * recv_buf, reponse_handler handler)
 {
     int r;
-    char recv_buf[96];
     TokBuf tok_key;
     TokBuf tok_val;
     TokBuf * ptok;
@@ -280,64 +368,65 @@ int client_response_iterate(reponse_handler handler)
     ptok = &tok_key;
 
     do {
-        bzero(recv_buf, sizeof(recv_buf));
-        r = read(s_socket, recv_buf, sizeof(recv_buf)-1);
+        r = read(s_socket, recv_buf, CLIENT_RESPONSE_SIZE);
         if (r < 0)
         {
             return -1;
         }
-        else
+        if ((r > 0) && (0 == s_response_ms))
         {
-            for (int i = 0; i < r; ++i)
+            s_response_ms = rtc_wall_ms();
+        }
+
+        for (int i = 0; i < r; ++i)
+        {
+            if (tok_append(ptok, recv_buf[i]))
             {
-                if (tok_append(ptok, recv_buf[i]))
+                if (ERI_BEGIN == state)
                 {
-                    if (ERI_BEGIN == state)
-                    {
-                        /* looking for HTTP header */
-                        if (0 == strncmp("HTTP/", tok_key.buf, 5))
-                        {
-                            state = ERI_HTTP_CODE;
-                        }
-                    }
-                    else if (ERI_HTTP_CODE == state)
+                    /* looking for HTTP header */
+                    if (0 == strncmp("HTTP/", tok_key.buf, 5))
                     {
-                        /* checking response code from server */
-                        /* we want 200 - OK */
-                        if (0 == strcmp("200", tok_key.buf))
-                        {
-                            status = 0;
-                            state = ERI_HEAD;
-                        }
-                        else
-                        {
-                            ESP_LOGE(TAG, "HTTP error status %s\n", tok_key.buf);
-                            return -3;
-                        }
+                        state = ERI_HTTP_CODE;
                     }
-                    else if (ERI_HEAD == state)
+                }
+                else if (ERI_HTTP_CODE == state)
+                {
+                    /* checking response code from server */
+                    /* we want 200 - OK */
+                    if (0 == strcmp("200", tok_key.buf))
                     {
-                        /* looking for magic word, which starts data */
-                        if (0 == strcmp(">gnIOT<", tok_key.buf))
-                        {
-                            state = ERI_KEY;
-                        }
+                        status = 0;
+                        state = ERI_HEAD;
                     }
-                    else if (ERI_KEY == state)
+                    else
                     {
-                        /* key copied, now find value */
-                        ptok = &tok_val;
-                        state = ERI_VALUE;
+                        ESP_LOGE(TAG, "HTTP error status %s\n", tok_key.buf);
+                        return -3;
                     }
-                    else if (ERI_VALUE == state)
+                }
+                else if (ERI_HEAD == state)
+                {
+                    /* looking for magic word, which starts data */
+                    if (0 == strcmp(">gnIOT<", tok_key.buf))
                     {
-                        /* pass key and value to handler callback
-                         * start reading another key */
-                        handler(tok_key.buf, tok_val.buf);
-                        ptok = &tok_key;
                         state = ERI_KEY;
                     }
                 }
+                else if (ERI_KEY == state)
+                {
+                    /* key copied, now find value */
+                    ptok = &tok_val;
+                    state = ERI_VALUE;
+                }
+                else if (ERI_VALUE == state)
+                {
+                    /* pass key and value to handler callback
+                     * start reading another key */
+                    handler(tok_key.buf, tok_val.buf);
+                    ptok = &tok_key;
+                    state = ERI_KEY;
+                }
             }
         }
     } while (r > 0);
@@ -345,12 +434,50 @@ int client_response_iterate(reponse_handler handler)
     return status;
 }
 
+int client_response_iterate(reponse_handler handler)
+{
+    int r;
+    char * recv_buf = iobuf_lease(IOBUF_RESPONSE, CLIENT_RESPONSE_SIZE);
+
+    if (NULL == recv_buf)
+    {
+        return -1;
+    }
+    r = response_iterate(recv_buf, handler);
+    iobuf_release(IOBUF_RESPONSE, recv_buf);
+    return r;
+}
+
+
+/**
+ * Space in request buffer from given position.
+ * @return capacity or 0 if out is not inside request buffer
+ */
+static int request_capacity(const char * out)
+{
+    size_t size;
+    const char * buf = iobuf_get(IOBUF_REQUEST, &size);
+
+    if ((NULL != buf) && (out > buf) && (out < &buf[size - 1]))
+    {
+        return (int) (size - (out - buf));
+    }
+    return 0;
+}
 
 int request_new(Request_t * request, const char * endpoint)
 {
     const GniotConfig_t * cfg = config_get();
-    int printed = snprintf(big_snd_buf, sizeof(big_snd_buf) - 1, "GET %s?id=%u", endpoint, cfg->my_id);
-    request->ptr = &big_snd_buf[printed];
+    char * buf = iobuf_lease(IOBUF_REQUEST, CLIENT_REQUEST_SIZE);
+    int printed;
+
+    if (NULL == buf)
+    {
+        request->ptr = NULL;
+        return -1;
+    }
+    printed = snprintf(buf, CLIENT_REQUEST_SIZE - 1, "GET %s?id=%u", endpoint, cfg->my_id);
+    request->ptr = &buf[printed];
 
     return 0;
 }
@@ -358,13 +485,19 @@ int request_new(Request_t * request, const char * endpoint)
 int request_sets(Request_t * request, const char * key, const char * value)
 {
     char * out = (char *) request->ptr;
-    int capacity = sizeof(big_snd_buf) - (((unsigned) out) - ((unsigned) big_snd_buf));
+    int capacity = request_capacity(out);
 
-    if ((out > big_snd_buf) && (out < &big_snd_buf[sizeof(big_snd_buf) - 1]))
+    if (capacity)
     {
         int printed = snprintf(out, capacity - 1, "&%s=%s", key, value);
-        request->ptr = &out[printed];
-        return 0;
+
+        if ((printed >= 0) && (printed < capacity - 1))
+        {
+            request->ptr = &out[printed];
+            return 0;
+        }
+        /* does not fit - drop truncated key */
+        *out = '\0';
     }
     return -1;
 }
@@ -372,13 +505,19 @@ int request_sets(Request_t * request, const char * key, const char * value)
 int request_seti(Request_t * request, const char * key, int32_t value)
 {
     char * out = (char *) request->ptr;
-    int capacity = sizeof(big_snd_buf) - (((unsigned) out) - ((unsigned) big_snd_buf));
+    int capacity = request_capacity(out);
 
-    if ((out > big_snd_buf) && (out < &big_snd_buf[sizeof(big_snd_buf) - 1]))
+    if (capacity)
     {
         int printed = snprintf(out, capacity - 1, "&%s=%d", key, value);
-        request->ptr = &out[printed];
-        return 0;
+
+        if ((printed >= 0) && (printed < capacity - 1))
+        {
+            request->ptr = &out[printed];
+            return 0;
+        }
+        /* does not fit - drop truncated key */
+        *out = '\0';
     }
     return -1;
 }
@@ -386,33 +525,63 @@ int request_seti(Request_t * request, const char * key, int32_t value)
 int request_setu(Request_t * request, const char * key, uint32_t value)
 {
     char * out = (char *) request->ptr;
-    int capacity = sizeof(big_snd_buf) - (((unsigned) out) - ((unsigned) big_snd_buf));
+    int capacity = request_capacity(out);
 
-    if ((out > big_snd_buf) && (out < &big_snd_buf[sizeof(big_snd_buf) - 1]))
+    if (capacity)
     {
         int printed = snprintf(out, capacity - 1, "&%s=%u", key, value);
-        request->ptr = &out[printed];
-        return 0;
+
+        if ((printed >= 0) && (printed < capacity - 1))
+        {
+            request->ptr = &out[printed];
+            return 0;
+        }
+        /* does not fit - drop truncated key */
+        *out = '\0';
     }
     return -1;
 }
 
-const char * request_make(Request_t * request)
+/**
+ * Complete request line and add headers.
+ * @param extra additional header lines (each ending with CRLF)
+ */
+static const char * request_finish(Request_t * request, const char * extra)
 {
     if (s_server_index < 2)
     {
         char * out = (char *) request->ptr;
-        int capacity = sizeof(big_snd_buf) - (((unsigned) out) - ((unsigned) big_snd_buf));
+        int capacity = request_capacity(out);
 
-        if ((out > big_snd_buf) && (out < &big_snd_buf[sizeof(big_snd_buf) - 1]))
+        if (capacity)
         {
-            snprintf(out, capacity - 1, " HTTP/1.0\r\n"
+            int printed = snprintf(out, capacity - 1, " HTTP/1.0\r\n"
                     "Host: %s:%s\r\n"
                     "User-Agent: esp-idf/1.0 esp32\r\n"
-                    "\r\n", s_servers[s_server_index].address, s_servers[s_server_index].port);
-            return big_snd_buf;
+                    "%s"
+                    "\r\n", s_servers[s_server_index].address, s_servers[s_server_index].port, extra);
+
+            /* truncated request would lack the empty line ending headers */
+            if ((printed >= 0) && (printed < capacity - 1))
+            {
+                return iobuf_get(IOBUF_REQUEST, NULL);
+            }
+            ESP_LOGE(TAG, "Request too long");
         }
     }
     return NULL;
 }
 
+const char * request_make(Request_t * request)
+{
+    return request_finish(request, "");
+}
+
+const char * request_make_range(Request_t * request, uint32_t offset)
+{
+    char range[32];
+
+    snprintf(range, sizeof(range), "Range: bytes=%u-\r\n", offset);
+    return request_finish(request, range);
+}
+
@@ -11,6 +11,28 @@
 
 #include <stdint.h>
 
+/**
+ * Request buffer [B], request is built in it by request_* functions.
+ * Not bigger than response buffer, so it costs no arena memory.
+ */
+#define CLIENT_REQUEST_SIZE     1024
+/**
+ * Space taken by request_make [B]: HTTP version, Host header (address up to
+ * 31 characters and port), User-Agent, empty line, terminating zero
+ * and one byte left unused by request_* functions.
+ */
+#define CLIENT_REQUEST_FRAME_MAX    91
+/**
+ * Receive buffer [B], response is read in chunks up to that size.
+ */
+#define CLIENT_RESPONSE_SIZE    1024
+/**
+ * I/O buffer arena (iobuf) needed by connection. Request is sent
+ * before response is read, so buffers share memory.
+ */
+#define CLIENT_IOBUF_SIZE       ((CLIENT_REQUEST_SIZE > CLIENT_RESPONSE_SIZE) ? \
+        CLIENT_REQUEST_SIZE : CLIENT_RESPONSE_SIZE)
+
 typedef int (*response_buf_handler)(const char * data, int length);
 typedef void (*reponse_handler)(const char * key, const char * value);
 
@@ -20,18 +42,33 @@ typedef struct {
 
 /**
  * Open connection to server.
+ * Takes I/O buffer arena (iobuf) for time of connection,
+ * unless it is open already.
  */
 int client_open(void);
 /**
  * Close connection with server.
  */
 int client_close(void);
+/**
+ * Cancel network work from another task.
+ * Pending socket operations fail and no new connection
+ * can be opened anymore.
+ */
+void client_abort(void);
 /**
  * Send data to server.
- * @param request complete HTTP request data
+ * Request buffer is given back to arena, whatever the result.
+ * @param request complete HTTP request data (from request_make)
  * @param length length of request string
  */
 int client_request(const char * request, int length);
+/**
+ * Local wall time when first byte of response to last
+ * request arrived (see client_response_iterate).
+ * @return time [ms since epoch], 0 if nothing arrived
+ */
+int64_t client_response_time_ms(void);
 /**
  * Get response from server - debug version.
  * This function simply prints to console all contents
@@ -51,11 +88,28 @@ int client_response_iterate(reponse_handler handler);
  */
 int client_response_hdl(response_buf_handler handler);
 
+/**
+ * Start request (takes request buffer, connection must be open).
+ * @return 0 on success
+ */
 int request_new(Request_t * request, const char * endpoint);
+/**
+ * Add key and value to request.
+ * @return 0 on success, -1 if it does not fit (request is left unchanged)
+ */
 int request_sets(Request_t * request, const char * key, const char * value);
 int request_seti(Request_t * request, const char * key, int32_t value);
 int request_setu(Request_t * request, const char * key, uint32_t value);
+/**
+ * Finish request.
+ * @return request data or NULL if request was not started
+ * or headers do not fit
+ */
 const char * request_make(Request_t * request);
+/**
+ * Finish request asking for part of resource, from given offset to end.
+ */
+const char * request_make_range(Request_t * request, uint32_t offset);
 
 
 #endif /* MAIN_CLIENT_H_ */
@@ -3,3 +3,15 @@
 #
 # (Uses default behaviour of compiling all source files in directory, adding 'include' to include path.)
 
+# Uncomment to read AM2322 over I2C instead of single-wire protocol.
+#CFLAGS += -DHUMTEMP_I2C
+# Uncomment to read two single-wire sensors, on GPIO2 and GPIO0.
+#CFLAGS += -DHUMTEMP_CHANNELS=2 -D'DHT_DATA_PINS={2,0}'
+# Uncomment to print captured single-wire edges ("DHT ..." lines) for test/dht_decode.
+#CFLAGS += -DDHT_TRACE
+
+# Release build ("make GNIOT_RELEASE=1"): console messages and ESP_LOG strings
+# of this component are compiled out. Image size gain not measured yet on target.
+ifdef GNIOT_RELEASE
+CFLAGS += -DGNIOT_RELEASE -DLOG_LOCAL_LEVEL=0
+endif
@@ -0,0 +1,25 @@
+/*
+ * Console output of diagnostic messages.
+ * debug.h
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#ifndef MAIN_DEBUG_H_
+#define MAIN_DEBUG_H_
+
+#include <stdio.h>
+
+/**
+ * Print diagnostic message on console.
+ * In release build (GNIOT_RELEASE) call and its format string are
+ * compiled out, arguments are still type checked.
+ */
+#ifndef GNIOT_RELEASE
+#define DBG_PRINTF(...)     printf(__VA_ARGS__)
+#else
+#define DBG_PRINTF(...)     do { if (0) printf(__VA_ARGS__); } while (0)
+#endif
+
+#endif /* MAIN_DEBUG_H_ */
@@ -0,0 +1,146 @@
+/**
+ * Decoder of DHT-11/AM2322 single-wire bit stream.
+ * dht_decode.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include <string.h>
+
+#include "dht_decode.h"
+
+/**
+ * Pulses shorter than that [us] are noise.
+ */
+#define GLITCH_US           8
+/**
+ * Nominal length of low part of data bit [us].
+ * Used for reconstructing missed edges.
+ */
+#define BIT_LOW_US          50
+/**
+ * High part of data bit longer than that [us] means '1'.
+ */
+#define BIT_ONE_US          50
+/**
+ * Data bits in transmission.
+ */
+#define DATA_BITS           (8 * DHT_DATA_BYTES)
+
+/**
+ * Most of edges taken into account.
+ */
+#define MAX_EDGES           (2 * DATA_BITS + 8)
+
+/**
+ * Cleaned up edges (in DHT_EDGE format). Every input edge
+ * produces at most two of them. Static, to keep it off the
+ * small stack of measurement task.
+ */
+static uint32_t s_list[2 * MAX_EDGES];
+
+/**
+ * Append edge to cleaned up list, fixing what can be fixed:
+ *  - two edges of the same level - opposite edge between was missed,
+ *    it is put back assuming nominal low pulse length,
+ *  - pulse shorter than glitch limit - both its edges are dropped.
+ * @return new length of list
+ */
+static int push_edge(uint32_t * list, int n, uint32_t t, uint32_t level, uint32_t ticks_per_us)
+{
+    if (n > 0)
+    {
+        uint32_t last = list[n - 1];
+        uint32_t dt = t - DHT_EDGE_TIME(last);
+
+        if (level == DHT_EDGE_LEVEL(last))
+        {
+            uint32_t low = BIT_LOW_US * ticks_per_us;
+
+            if (dt <= low)
+            {
+                /* too close to tell what was lost, keep the first one */
+                return n;
+            }
+            if (level)
+            {
+                /* rise, (missed fall), rise: fall was one low pulse before */
+                list[n] = DHT_EDGE(t - low, 0);
+            }
+            else
+            {
+                /* fall, (missed rise), fall: rise was one low pulse after */
+                list[n] = DHT_EDGE(DHT_EDGE_TIME(last) + low, 1);
+            }
+            ++n;
+        }
+        else if (dt < GLITCH_US * ticks_per_us)
+        {
+            /* glitch - forget about it and edge that started it */
+            return n - 1;
+        }
+    }
+
+    list[n] = DHT_EDGE(t, level);
+    return n + 1;
+}
+
+int dht_decode(const uint32_t * edges, int count, uint32_t ticks_per_us, uint8_t * out)
+{
+    uint32_t * list = s_list;
+    int n = 0;
+    int highs = 0;
+    int bit;
+    int i;
+
+    memset(out, 0, DHT_DATA_BYTES);
+
+    /* only the tail of capture matters, data bits are sent last */
+    if (count > MAX_EDGES)
+    {
+        edges += count - MAX_EDGES;
+        count = MAX_EDGES;
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+        n = push_edge(list, n, DHT_EDGE_TIME(edges[i]), DHT_EDGE_LEVEL(edges[i]), ticks_per_us);
+    }
+
+    /* count complete high pulses (rise followed by fall) */
+    for (i = 1; i < n; ++i)
+    {
+        if (DHT_EDGE_LEVEL(list[i - 1]) && !DHT_EDGE_LEVEL(list[i]))
+        {
+            ++highs;
+        }
+    }
+
+    if (highs < DATA_BITS)
+    {
+        return DHT_DECODE_E_SHORT;
+    }
+
+    /* last 40 high pulses are data bits, pulses before
+     * belong to start of transmission */
+    bit = DATA_BITS - highs;
+    for (i = 1; i < n; ++i)
+    {
+        if (DHT_EDGE_LEVEL(list[i - 1]) && !DHT_EDGE_LEVEL(list[i]))
+        {
+            if (bit >= 0)
+            {
+                uint32_t high_us = (DHT_EDGE_TIME(list[i]) - DHT_EDGE_TIME(list[i - 1])) / ticks_per_us;
+
+                if (high_us > BIT_ONE_US)
+                {
+                    out[bit >> 3] |= (1 << (7 - (bit & 7)));
+                }
+            }
+            ++bit;
+        }
+    }
+
+    return DHT_DECODE_OK;
+}
@@ -0,0 +1,43 @@
+/**
+ * Decoder of DHT-11/AM2322 single-wire bit stream.
+ * Works on timestamps of signal edges captured by interrupt.
+ *
+ * dht_decode.h
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#ifndef MAIN_DHT_DECODE_H_
+#define MAIN_DHT_DECODE_H_
+
+#include <stdint.h>
+
+#define DHT_DECODE_OK       0   /**< 40 bits decoded. */
+#define DHT_DECODE_E_SHORT  1   /**< Not enough bits in captured signal. */
+
+/**
+ * Number of data bytes sent by sensor (including checksum).
+ */
+#define DHT_DATA_BYTES      5
+
+/**
+ * Make edge record from CCOUNT value and line level after the edge.
+ * Lowest bit of tick count is sacrificed for the level.
+ */
+#define DHT_EDGE(CC, LEVEL)     (((CC) & ~1UL) | ((LEVEL) & 1UL))
+#define DHT_EDGE_LEVEL(E)       ((E) & 1UL)
+#define DHT_EDGE_TIME(E)        ((E) & ~1UL)
+
+/**
+ * Decode data bits from captured edges.
+ * Tolerates single missing edges and short glitches.
+ * @param edges edge records (see DHT_EDGE) in order of capture
+ * @param count number of edges
+ * @param ticks_per_us CPU ticks per microsecond at time of capture
+ * @param out output for DHT_DATA_BYTES bytes of data (checksum not verified)
+ * @return DHT_DECODE_OK or error code
+ */
+int dht_decode(const uint32_t * edges, int count, uint32_t ticks_per_us, uint8_t * out);
+
+#endif /* MAIN_DHT_DECODE_H_ */
@@ -0,0 +1,159 @@
+/*
+ * Energy accounting - estimate charge used per wake and per sample.
+ * energy.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "energy.h"
+#include "power.h"
+#include "storage.h"
+#include "rtc.h"
+#include "debug.h"
+
+/*
+ * Counters kept in RTC memory:
+ *  RTC_WORD_ENERGY_CHARGE  charge [uC] used since last report
+ *  RTC_WORD_ENERGY_COUNT   bits 0-15 samples, bits 16-31 wakes since last report
+ */
+#define COUNT_SAMPLES(W)    ((W) & 0xFFFF)
+#define COUNT_WAKES(W)      ((W) >> 16)
+
+static struct
+{
+    uint64_t last_ms;                       /**< Last time charge was integrated. */
+    uint32_t charge_uc;                     /**< Charge used in this wake [uC]. */
+    bool radio;                             /**< Radio is on. */
+    uint32_t samples;                       /**< Samples produced in this wake. */
+    uint64_t phase_start[ENERGY_PH_COUNT];  /**< Start of running phase [ms], 0 - not running. */
+    uint32_t phase_ms[ENERGY_PH_COUNT];     /**< Total time of phase [ms]. */
+} s_energy;
+
+/**
+ * Current drawn now [0.1mA], according to configured model.
+ */
+static uint32_t current_now(void)
+{
+    const GniotConfig_t * cfg = config_get();
+    uint32_t current = (power_cpu_mhz() > 80) ? cfg->current_cpu_fast : cfg->current_cpu;
+
+    if (s_energy.radio)
+    {
+        current += cfg->current_radio;
+    }
+    return current;
+}
+
+void energy_update(void)
+{
+    uint64_t now = rtc_monotonic_ms();
+    uint32_t dt_ms = (uint32_t) (now - s_energy.last_ms);
+
+    /* 0.1mA * ms = 0.1uC */
+    s_energy.charge_uc += (dt_ms * current_now()) / 10;
+    s_energy.last_ms = now;
+}
+
+void energy_init(void)
+{
+    uint64_t now = rtc_monotonic_ms();
+
+    memset(&s_energy, 0, sizeof(s_energy));
+
+    /* boot phase: from reset till now, CPU at default clock,
+     * radio off */
+    s_energy.phase_ms[ENERGY_PH_BOOT] = (uint32_t) now;
+    s_energy.last_ms = 0;
+    energy_update();
+}
+
+void energy_phase_begin(EnergyPhase_t phase)
+{
+    s_energy.phase_start[phase] = rtc_monotonic_ms();
+}
+
+void energy_phase_end(EnergyPhase_t phase)
+{
+    if (s_energy.phase_start[phase])
+    {
+        s_energy.phase_ms[phase] += (uint32_t) (rtc_monotonic_ms() - s_energy.phase_start[phase]);
+        s_energy.phase_start[phase] = 0;
+    }
+}
+
+void energy_radio(bool on)
+{
+    energy_update();
+    s_energy.radio = on;
+}
+
+void energy_sample(void)
+{
+    ++s_energy.samples;
+}
+
+void energy_sleep(uint32_t sleep_s)
+{
+    uint32_t charge;
+    uint32_t count;
+    uint32_t samples;
+    uint32_t wakes;
+
+    energy_phase_end(ENERGY_PH_SLEEP);
+    energy_update();
+
+    DBG_PRINTF("Wake: %u ms, %u uC, phases [ms] boot %u init %u sampling %u wifi %u upload %u ota %u sleep %u\n",
+            (unsigned) s_energy.last_ms, s_energy.charge_uc,
+            s_energy.phase_ms[ENERGY_PH_BOOT], s_energy.phase_ms[ENERGY_PH_SENSOR_INIT],
+            s_energy.phase_ms[ENERGY_PH_SAMPLING], s_energy.phase_ms[ENERGY_PH_WIFI],
+            s_energy.phase_ms[ENERGY_PH_UPLOAD], s_energy.phase_ms[ENERGY_PH_OTA],
+            s_energy.phase_ms[ENERGY_PH_SLEEP]);
+
+    /* reported in next wake, upload is over by now */
+    rtc_word_set(RTC_WORD_ENERGY_SLEEP, s_energy.phase_ms[ENERGY_PH_SLEEP]);
+
+    /* uA * s = uC */
+    charge = rtc_word_get(RTC_WORD_ENERGY_CHARGE);
+    charge += s_energy.charge_uc + sleep_s * config_get()->current_sleep;
+    rtc_word_set(RTC_WORD_ENERGY_CHARGE, charge);
+
+    count = rtc_word_get(RTC_WORD_ENERGY_COUNT);
+    samples = COUNT_SAMPLES(count) + s_energy.samples;
+    wakes = COUNT_WAKES(count) + 1;
+    if (samples > 0xFFFF) samples = 0xFFFF;
+    if (wakes > 0xFFFF) wakes = 0xFFFF;
+    rtc_word_set(RTC_WORD_ENERGY_COUNT, samples | (wakes << 16));
+}
+
+void energy_report(Request_t * request)
+{
+    uint32_t count = rtc_word_get(RTC_WORD_ENERGY_COUNT);
+
+    if (count)
+    {
+        request_setu(request, "e_uc", rtc_word_get(RTC_WORD_ENERGY_CHARGE));
+        request_setu(request, "e_n", COUNT_SAMPLES(count));
+        request_setu(request, "e_w", COUNT_WAKES(count));
+    }
+
+    /* going to sleep last time */
+    if (rtc_word_get(RTC_WORD_ENERGY_SLEEP))
+    {
+        request_setu(request, "e_sl", rtc_word_get(RTC_WORD_ENERGY_SLEEP));
+    }
+
+    /* this wake so far: time spent with sensor and total */
+    request_setu(request, "e_sens", s_energy.phase_ms[ENERGY_PH_SENSOR_INIT]
+            + s_energy.phase_ms[ENERGY_PH_SAMPLING]);
+    request_setu(request, "e_up", (uint32_t) rtc_monotonic_ms());
+}
+
+void energy_report_done(void)
+{
+    rtc_word_set(RTC_WORD_ENERGY_CHARGE, 0);
+    rtc_word_set(RTC_WORD_ENERGY_COUNT, 0);
+}
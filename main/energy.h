@@ -0,0 +1,77 @@
+/*
+ * Energy accounting - estimate charge used per wake and per sample.
+ * energy.h
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#ifndef MAIN_ENERGY_H_
+#define MAIN_ENERGY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "client.h"
+
+/**
+ * Phases of wake cycle which are timed.
+ * Phases from different tasks can overlap.
+ */
+typedef enum
+{
+    ENERGY_PH_BOOT,         /**< From reset till app_main. */
+    ENERGY_PH_SENSOR_INIT,  /**< Waiting for sensor to be ready. */
+    ENERGY_PH_SAMPLING,     /**< Reading sensor. */
+    ENERGY_PH_WIFI,         /**< Connecting to AP. */
+    ENERGY_PH_UPLOAD,       /**< Talking with server. */
+    ENERGY_PH_OTA,          /**< Firmware download. */
+    ENERGY_PH_SLEEP,        /**< Going to sleep (till energy_sleep). */
+    ENERGY_PH_COUNT
+} EnergyPhase_t;
+
+/**
+ * Initialize module, account for boot phase.
+ */
+void energy_init(void);
+/**
+ * Start timing of phase.
+ */
+void energy_phase_begin(EnergyPhase_t phase);
+/**
+ * Stop timing of phase.
+ */
+void energy_phase_end(EnergyPhase_t phase);
+/**
+ * Radio was turned on/off.
+ */
+void energy_radio(bool on);
+/**
+ * CPU clock is about to change, account charge used so far.
+ */
+void energy_update(void);
+/**
+ * Sample was produced during this wake.
+ */
+void energy_sample(void);
+/**
+ * Finish accounting of this wake (ends ENERGY_PH_SLEEP, call right
+ * before deep sleep) and add charge used by deep sleep of given length.
+ * Totals are kept in RTC memory.
+ * @param sleep_s sleep length [s]
+ */
+void energy_sleep(uint32_t sleep_s);
+/**
+ * Longest text added by energy_report [B].
+ */
+#define ENERGY_REPORT_MAX       86
+/**
+ * Append accumulated totals to request.
+ */
+void energy_report(Request_t * request);
+/**
+ * Totals were received by server, start counting again.
+ */
+void energy_report_done(void);
+
+#endif /* MAIN_ENERGY_H_ */
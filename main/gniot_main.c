@@ -5,10 +5,10 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
 #include "esp_system.h"
 #include "esp_spi_flash.h"
 #include "esp_sleep.h"
@@ -23,12 +23,15 @@
 #include "client.h"
 #include "service.h"
 #include "rtc.h"
-
-#define MEAS_FAILED     0xFFFFFFFF
-#define MEAS_FINISHED   0xFFFFFFF0
-
-static xQueueHandle s_measurement_queue = NULL;
-
+#include "power.h"
+#include "supervisor.h"
+#include "scheduler.h"
+#include "energy.h"
+#include "record_ring.h"
+#include "ota.h"
+#include "debug.h"
+
+#ifndef GNIOT_RELEASE
 static void debug_hello(void)
 {
     esp_chip_info_t chip_info;
@@ -41,8 +44,10 @@ static void debug_hello(void)
     printf("Time: %u\n", get_timestamp());
     printf("Measure period [s]: %d\n", (int) cfg->measure_period);
     printf("Samples per measurement: %d\n", (int) cfg->samples_per_measure);
+    printf("Convergence tolerance: %d\n", (int) cfg->converge_tol);
     printf("Measurements per sleep : %d\n", (int) cfg->measures_per_sleep);
     printf("Sleep length [m]: %d\n", (int) cfg->sleep_length);
+    printf("Wake budget [s]: %d\n", (int) cfg->wake_budget);
     printf("Main server: %s:%d\n", cfg->server_address, (int)  cfg->server_port);
     printf("Backup server: %s:%d\n", cfg->fallback_server_address, (int)  cfg->fallback_server_port);
 
@@ -56,17 +61,26 @@ static void debug_hello(void)
     printf("%dMB %s flash\n", spi_flash_get_chip_size() / (1024 * 1024),
             (chip_info.features & CHIP_FEATURE_EMB_FLASH) ? "embedded" : "external");
 }
+#endif
 
 static void measurements_task(void * arg)
 {
     const GniotConfig_t * cfg = config_get();
-    int sidx;
+    int sidx[HUMTEMP_CHANNELS];
+    bool done[HUMTEMP_CHANNELS];
+    int pending;
     int total_reads = 0;
-    uint32_t meas;
-    int result;
+    MeasRecord_t record = {0};
+    uint32_t capture_ts;
+    int window = 0;
+    bool last;
+    int ch;
     int i = 0;
 
+    energy_phase_begin(ENERGY_PH_SENSOR_INIT);
     humtemp_init();
+    energy_phase_end(ENERGY_PH_SENSOR_INIT);
+    measurement_window_reset();
 
     while (1)
     {
@@ -74,47 +88,125 @@ static void measurements_task(void * arg)
         // re-init measurement data
         measurement_init(cfg);
         total_reads = 0;
+        pending = HUMTEMP_CHANNELS;
+        for (ch = 0; ch < HUMTEMP_CHANNELS; ++ch)
+        {
+            sidx[ch] = 0;
+            done[ch] = (0 == cfg->samples_per_measure);
+        }
+        energy_phase_begin(ENERGY_PH_SAMPLING);
 
-        // get a few samples from hum+temp sensor,
+        // get a few samples from every hum+temp sensor,
         // in case of failure try again, but not more
-        // than 2 times planned amount
-        for (sidx = 0; (sidx < cfg->samples_per_measure)
-                && (total_reads < (cfg->samples_per_measure) * 2);
+        // than 2 times planned amount;
+        // sensors are read in turns, so one is read while
+        // others wait for their minimal read interval
+        for (; pending && (total_reads < (cfg->samples_per_measure) * 2);
                 ++total_reads)
         {
-            Humidity_t h;
-            Temperature_t t;
-
-            if (0 == humtemp_read(&h, &t))
+            for (ch = 0; ch < HUMTEMP_CHANNELS; ++ch)
             {
-                printf("T = %d dsC  RH = %d promili\n", t, h);
-                measurement_add_sample(h, t);
-                ++sidx;
+                Humidity_t h;
+                Temperature_t t;
+
+                if (done[ch])
+                {
+                    continue;
+                }
+
+                // waits for sensor to be ready by itself
+                ++record.reads;
+                if (0 == humtemp_read(ch, &h, &t))
+                {
+                    DBG_PRINTF("%d: T = %d dsC  RH = %d promili\n", ch, t, h);
+                    measurement_add_sample(ch, h, t);
+                    ++sidx[ch];
+
+                    if (sidx[ch] >= cfg->samples_per_measure)
+                    {
+                        done[ch] = true;
+                    }
+                    // readings agree - no need for more
+                    else if (measurement_converged(ch, cfg->converge_tol))
+                    {
+                        DBG_PRINTF("%d: Converged after %d samples\n", ch, sidx[ch]);
+                        done[ch] = true;
+                    }
+
+                    if (done[ch])
+                    {
+                        --pending;
+                    }
+                }
+                else
+                {
+                    ++record.errors;
+                }
             }
-            vTaskDelay(2500 / portTICK_PERIOD_MS);
         }
+        capture_ts = get_timestamp();
 
         // get final value of measurement
         // we choose median value of samples, to get rid of
         // outliers
-        result = measurement_get(&meas);
+        for (ch = 0; ch < HUMTEMP_CHANNELS; ++ch)
+        {
+            HumTempStats_t stats;
+            uint32_t meas;
+
+            if (0 == measurement_get(ch, &meas))
+            {
+                energy_sample();
+                measurement_window_add(meas);
+            }
+            else
+            {
+                DBG_PRINTF("Measurement %d failed\n", ch);
+            }
 
-        // regardless if measurement was successful or not,
+            humtemp_stats(ch, &stats);
+            DBG_PRINTF("Sensor %d: %u/%u reads ok (crc %u, timeout %u), last %u us\n",
+                    ch, stats.ok, stats.reads, stats.checksum_errors, stats.timeouts,
+                    stats.last_latency_us);
+        }
+        energy_phase_end(ENERGY_PH_SAMPLING);
+
+        ++i;
+        ++window;
+        last = cfg->measures_per_sleep && (i >= cfg->measures_per_sleep);
+
+        // aggregation window is closed when full or when going to sleep,
+        // regardless if measurements were successful or not,
         // we will notify main task, that measurement has taken
         // place
-        if (!result)
-        {
-            xQueueSendToBack(s_measurement_queue, &meas, 0);
-        }
-        else
+        if (last || (window >= cfg->agg_window))
         {
-            uint32_t dummy = MEAS_FAILED;
-            xQueueSendToBack(s_measurement_queue, &dummy, 0);
+            record.type = REC_MEASUREMENT;
+            record.count = 0;
+            for (ch = 0; ch < HUMTEMP_CHANNELS; ++ch)
+            {
+                StorageSample_t * s = &record.samples[record.count];
+                int n = measurement_window_get(ch, capture_ts, s);
+
+                // skip values that did not change enough
+                // since last reported one
+                if (n && !measurement_deadband_pass(s[0].data, capture_ts, cfg))
+                {
+                    DBG_PRINTF("%d: Within deadband, not reported\n", ch);
+                    n = 0;
+                }
+                record.count += n;
+            }
+            if (!record_ring_push(&record))
+            {
+                DBG_PRINTF("Record ring full, measurement lost\n");
+            }
+            record.reads = 0;
+            record.errors = 0;
+            window = 0;
         }
 
-        ++i;
-
-        if (cfg->measures_per_sleep && (i >= cfg->measures_per_sleep))
+        if (last)
         {
             break;
         }
@@ -124,9 +216,11 @@ static void measurements_task(void * arg)
 
     // send message to main task, that all planned measurements have
     // ended and sleep can be started
+    record.type = REC_FINISHED;
+    record.count = 0;
+    while (!record_ring_push(&record))
     {
-        uint32_t dummy = MEAS_FINISHED;
-        xQueueSendToBack(s_measurement_queue, &dummy, 0);
+        vTaskDelay(100 / portTICK_PERIOD_MS);
     }
 
     // infinite wait loop
@@ -260,15 +354,29 @@ void wifi_scan_test(void)
 void app_main()
 {
     int conn_result;
-    int sleep_min;
+    const GniotConfig_t * cfg;
+    SchedInput_t sched = {0};
 
     /* read nonvolatile data */
     storage_init();
     config_init();
     time_init();
+    energy_init();
+    power_init();
 
+    /* limit time we can spend awake, measurement schedule
+     * is added on top of configured budget */
+    cfg = config_get();
+    if (cfg->measures_per_sleep && cfg->wake_budget)
+    {
+        supervisor_start(cfg->wake_budget
+                + (cfg->measures_per_sleep - 1) * cfg->measure_period);
+    }
+
+#ifndef GNIOT_RELEASE
     /* Print chip information */
     debug_hello();
+#endif
 
 #ifdef TIME_TEST
     time_test();
@@ -280,16 +388,32 @@ void app_main()
     vTaskDelay(3000 / portTICK_PERIOD_MS);
 #endif
 
-    /* create a queue for intertask comm */
-    s_measurement_queue = xQueueCreate(10, sizeof(uint32_t));
+    /* records from measurement task wake up this one */
+    record_ring_init();
     /* start measurements task */
     xTaskCreate(measurements_task, "measurements_task", 2048, NULL, 10, NULL);
 
-    conn_result = wifi_connect();
+    if (scheduler_should_connect())
+    {
+        uint64_t conn_start = rtc_monotonic_ms();
+
+        sched.connect_tried = true;
+        energy_phase_begin(ENERGY_PH_WIFI);
+        conn_result = wifi_connect();
+        energy_phase_end(ENERGY_PH_WIFI);
+        sched.connect_ms = (uint32_t) (rtc_monotonic_ms() - conn_start);
+    }
+    else
+    {
+        // batching samples offline this time
+        DBG_PRINTF("Not connecting this time\n");
+        conn_result = -5;
+    }
 
     if (0 == conn_result)
     {
-        printf("Connected to wifi. IP address = %s\n", wifi_getIpAddress());
+        DBG_PRINTF("Connected to wifi. IP address = %s\n", wifi_getIpAddress());
+        wifi_rssi(&sched.rssi);
 
 #ifdef WIFI_SCAN_TEST
         vTaskDelay(1000 / portTICK_PERIOD_MS);
@@ -299,48 +423,67 @@ void app_main()
 
     while (1)
     {
-        uint32_t meas;
+        MeasRecord_t record;
 
-        if (xQueueReceive(s_measurement_queue, &meas, portMAX_DELAY))
+        if (supervisor_expired())
         {
-            if (MEAS_FAILED == meas)
+            // out of time - keep whatever was measured
+            // for next wake and go to sleep
+            supervisor_work_begin();
+            while (record_ring_pop(&record, 0))
             {
-                // no measurement was taken (failure) but
-                // we will try to send message to server anyway
-                // to show that we are alive
-                printf("Measurement failed\n");
-                service_send(conn_result, NO_MEASUREMENT);
+                if (REC_MEASUREMENT == record.type)
+                {
+                    service_send(-1, record.samples, record.count);
+                }
             }
-            else if (MEAS_FINISHED == meas)
+            supervisor_work_end();
+            break;
+        }
+
+        // record is taken only inside work on data, so forced
+        // sleep either gets it from ring or leaves it to this task
+        if (record_ring_wait(1000 / portTICK_PERIOD_MS))
+        {
+            supervisor_work_begin();
+            record_ring_pop(&record, 0);
+            if (REC_FINISHED == record.type)
             {
                 // leave loop - go to sleep
+                supervisor_work_end();
                 break;
             }
-            else
+
+            DBG_PRINTF("Record: %d samples, %u/%u sensor reads failed\n",
+                    record.count, record.errors, record.reads);
+
+            // even if no measurement was taken (failure)
+            // we will try to send message to server anyway
+            // to show that we are alive
+            if (0 == service_send(conn_result, record.samples, record.count))
             {
-                // send message to server
-                service_send(conn_result, meas);
+                sched.upload_ok = true;
             }
+            supervisor_work_end();
         }
     }
 
     wifi_disconnect();
 
-    // deep sleep - turn everything off except from RTC
-    // requires physical connection of WAKE pin with RST pin!
-    sleep_min = config_get()->sleep_length;
-    printf("Going to sleep for %d minutes\n", sleep_min);
-    fflush(stdout);
-    save_timestamp(sleep_min * 60);
-    esp_deep_sleep(sleep_min * 60 * 1000000);
+    // storage is used till sleep
+    supervisor_work_begin();
+    sched.backlog = storage_backlog();
+    sched.vdd_mv = power_supply_mv();
+    supervisor_set_sleep(scheduler_next_sleep(&sched));
+    supervisor_sleep();
 
     // code below should not be executed anymore
     for (int i = 10; i >= 0; i--)
     {
-        printf("Restarting in %d seconds...\n", i);
+        DBG_PRINTF("Restarting in %d seconds...\n", i);
         vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
-    printf("Restarting now.\n");
+    DBG_PRINTF("Restarting now.\n");
     fflush(stdout);
     esp_restart();
 }
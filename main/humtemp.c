@@ -1,5 +1,5 @@
 /**
- * Driver for reading from DHT-11 temperature and humidity sensor.
+ * Driver for reading from DHT-11 temperature and humidity sensors.
  * humtemp.c
  *
  *  Created on: 8 lut 2021
@@ -10,24 +10,44 @@
 #include <string.h>
 
 #include "humtemp.h"
+#include "dht_decode.h"
+#include "power.h"
+#include "debug.h"
 
 #include "driver/gpio.h"
+#include "esp8266/gpio_struct.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
 
+#include "esp_attr.h"
+#include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+
+#ifndef HUMTEMP_I2C
 
 /**
- * GPIO used for data line to DHT11 chip.
+ * GPIOs used for data lines of DHT chips, one per channel.
  */
-#define DHT_DATA_PIN    2
+#ifndef DHT_DATA_PINS
+#define DHT_DATA_PINS   { 2 }
+#endif
 
 /**
- * How many clock ticks (in CCOUNT register) per microsecond?
+ * Size of ring of captured edges (power of 2).
+ * Complete transmission is about 84 edges.
+ */
+#define DHT_EDGE_RING_SIZE  128
+/**
+ * Expected number of edges in transmission (host release,
+ * response low+high, 40 bits).
+ */
+#define DHT_EDGE_COUNT      84
+/**
+ * Give up waiting for sensor after that [ms].
  */
-#define CLOCK_TICKS_PER_MICROSECOND 80 // WARNING! Assumption that we run 80MHz clock!
+#define DHT_READ_TIMEOUT_MS 100
 
 /**
  * Prefix for E_LOG.
@@ -35,31 +55,48 @@
 static const char *TAG = "HumTemp";
 
 /**
- * Queue for passing events from IRQ to task.
+ * Single sensor instance.
  */
-static xQueueHandle evt_queue = NULL;
+typedef struct
+{
+    /**
+     * GPIO of data line.
+     */
+    uint8_t pin;
+    /**
+     * Edge timestamps captured by interrupt, see DHT_EDGE.
+     * Written only by interrupt, read by task after transmission.
+     */
+    volatile uint32_t edges[DHT_EDGE_RING_SIZE];
+    /**
+     * Count of all edges captured (index of next write).
+     */
+    volatile uint32_t head;
+    /**
+     * Time when sensor can be read again [us since boot].
+     */
+    int64_t ready_us;
+    /**
+     * Read statistics.
+     */
+    HumTempStats_t stats;
+} DhtSensor_t;
+
+static const uint8_t s_pins[HUMTEMP_CHANNELS] = DHT_DATA_PINS;
+
+static DhtSensor_t s_sensors[HUMTEMP_CHANNELS];
 
 /**
- * Read state machine states.
+ * Edges of last transmission, copied out of ring for decoding.
  */
-static enum {
-    E_DHT_RD_IDLE,          /**< Nothing to be done. */
-    E_DHT_RD_START,         /**< Start bit. */
-    E_DHT_RD_START_HIGH,    /**< Start bit continuation. */
-    E_DHT_RD_BIT_A,         /**< Low part of data bit. */
-    E_DHT_RD_BIT_B,         /**< High part of data bit. */
-} s_dht_read_state;
-
-static uint32_t s_prev_time;    /**< Store clock ticks of previous state. */
+static uint32_t s_capture[DHT_EDGE_RING_SIZE];
 
 /**
- * Temporary buffer for storing bits read from DHT.
+ * How many clock ticks (in CCOUNT register) per microsecond?
+ * Read from current CPU clock at start of every transaction,
+ * clock is not allowed to change until transaction ends.
  */
-static struct
-{
-    uint8_t bit;    /**< Index of current bit. */
-    uint8_t dat[5]; /**< Values read. */
-} s_read;
+static uint32_t s_ticks_per_us = 80;
 
 /**
  * Get number of clock ticks from CCOUNT register.
@@ -73,33 +110,11 @@ static inline uint32_t asm_ccount(void)
     return r;
 }
 
-/**
- * Calculate time difference in microseconds, between given tick count value and
- * previous measurement.
- */
-static uint32_t time_diff_cc_us(uint32_t later_cc)
-{
-    uint32_t td;
-
-    /* check for counter overflow. */
-    if (later_cc > s_prev_time)
-    {
-        td = (later_cc - s_prev_time) / CLOCK_TICKS_PER_MICROSECOND;
-    }
-    else
-    {
-        td = (0xFFFFFFFFULL - s_prev_time) + 1ULL + later_cc;
-        td /= CLOCK_TICKS_PER_MICROSECOND;
-    }
-
-    return td;
-}
-
 /**
  * Set pin connected to DHT-11 data as output.
  * Prepare for first phase of DHT data read - read request sending.
  */
-static void set_output(void)
+static void set_output(uint8_t pin)
 {
     gpio_config_t io_conf;
     //disable interrupt
@@ -107,7 +122,7 @@ static void set_output(void)
     //set as output mode
     io_conf.mode = GPIO_MODE_OUTPUT;
     //bit mask of the pins that you want to set,e.g.GPIO15/16
-    io_conf.pin_bit_mask = (1ULL << DHT_DATA_PIN);
+    io_conf.pin_bit_mask = (1ULL << pin);
     //disable pull-down mode
     io_conf.pull_down_en = 0;
     //disable pull-up mode
@@ -121,187 +136,214 @@ static void set_output(void)
  * Prepare for second phase of DHT data read -
  * capture of data.
  */
-static void set_input(void)
+static void set_input(uint8_t pin)
 {
     gpio_config_t io_conf;
     // enable interrupt for both edges of signal
     io_conf.intr_type = GPIO_INTR_ANYEDGE;
     // set as input mode
     io_conf.mode = GPIO_MODE_INPUT;
-    io_conf.pin_bit_mask = (1ULL << DHT_DATA_PIN);
+    io_conf.pin_bit_mask = (1ULL << pin);
     io_conf.pull_down_en = 0;
     io_conf.pull_up_en = 0;
     gpio_config(&io_conf);
 }
 
 /**
- * Update temporary buffer of DHT data with single bit.
- * @return true if all data collected
+ * Interrupt handler for all DHT data pins.
+ * Only stores tick count and line level of the edge in ring
+ * of sensor which pin changed, decoding is done by task
+ * when transmission is over.
+ * Runs from IRAM, so flash cache misses do not add jitter.
  */
-static int add_bit(int b)
+static void IRAM_ATTR gpio_isr_handler(void * arg)
 {
-    if (b)
+    uint32_t now_cc = asm_ccount();
+    uint32_t status = GPIO.status;
+    uint32_t in = GPIO.in;
+
+    GPIO.status_w1tc = status;
+
+    for (int ch = 0; ch < HUMTEMP_CHANNELS; ++ch)
     {
-        s_read.dat[s_read.bit >> 3] |= (1 << (7 - (s_read.bit & 7)));
-    }
+        DhtSensor_t * sensor = &s_sensors[ch];
 
-    ++s_read.bit;
-    return (s_read.bit >= 40);
+        if (status & (1UL << sensor->pin))
+        {
+            uint32_t head = sensor->head;
+            sensor->edges[head & (DHT_EDGE_RING_SIZE - 1)] = DHT_EDGE(now_cc, in >> sensor->pin);
+            sensor->head = head + 1;
+        }
+    }
 }
 
 /**
- * Interrupt handler for both edges of DHT-11 data pin.
- * Reads data and appends it to temporary buffer.
- * hen all data is read it sends message to queue.
+ * Wait until sensor can be read, reserve time of next read.
  */
-static void gpio_isr_handler(void * arg)
+static void wait_ready(DhtSensor_t * sensor)
 {
-    // Get accurate CPU "timestamp" of given moment.
-    uint32_t now_cc = asm_ccount();
-    // Get how many microseconds since previous read state
-    uint32_t dt_us = time_diff_cc_us(now_cc);
-    // Get state of DATA pin (high/low?)
-    int data_state = gpio_get_level(DHT_DATA_PIN);
-
-    /*
-     * FSM-like logic for reading data.
-     * Interrupt should be called for every change of DATA signal,
-     * in case it is called more often, we check with clock count
-     * to see where we are in expected waveform.
-     */
-    if (E_DHT_RD_START == s_dht_read_state)
-    {
-        if (data_state && (dt_us > 80))
-        {
-            /* at least 80 microseconds from start of transaction
-             * and DATA is HIGH, that means we are in start bit
-             * and can continue */
-            s_dht_read_state = E_DHT_RD_START_HIGH;
-        }
-    }
-    else if (E_DHT_RD_START_HIGH == s_dht_read_state)
+    int64_t now = esp_timer_get_time();
+
+    if (now < sensor->ready_us)
     {
-        if (!data_state && (dt_us > 160))
-        {
-            /* at lease 160 microseconds from start of transaction
-             * and DATA is LOW, the next DATA transition will be a
-             * first data bit */
-            s_dht_read_state = E_DHT_RD_BIT_A;
-            s_prev_time = now_cc;
-            s_read.bit = 0;
-            memset(s_read.dat, 0, sizeof(s_read.dat));
-        }
+        vTaskDelay((uint32_t) ((sensor->ready_us - now) / 1000) / portTICK_RATE_MS + 1);
+        now = esp_timer_get_time();
     }
-    else if (E_DHT_RD_BIT_A == s_dht_read_state)
+    sensor->ready_us = now + HT_MIN_INTERVAL_MS * 1000LL;
+}
+
+void humtemp_init(void)
+{
+    /* after deep sleep sensor was powered all the time,
+     * after cold boot it needs time to start (counted from boot) */
+    int64_t ready_us = (ESP_RST_DEEPSLEEP == esp_reset_reason()) ? 0 : (HT_POWERUP_MS * 1000LL);
+
+    memset(s_sensors, 0, sizeof(s_sensors));
+    for (int ch = 0; ch < HUMTEMP_CHANNELS; ++ch)
     {
-        if (data_state && (dt_us > 30))
-        {
-            s_dht_read_state = E_DHT_RD_BIT_B;
-            s_prev_time = now_cc;
-        }
+        s_sensors[ch].pin = s_pins[ch];
+        s_sensors[ch].ready_us = ready_us;
     }
-    else if (E_DHT_RD_BIT_B == s_dht_read_state)
-    {
-        if (!data_state && (dt_us > 10))
-        {
-            int done;
 
-            s_dht_read_state = E_DHT_RD_BIT_A;
-            s_prev_time = now_cc;
+    /* own interrupt handler for all GPIOs, shared by all sensors */
+    gpio_isr_register(gpio_isr_handler, NULL, 0, NULL);
+}
 
-            /* We determine the type of bit sent by DHT (1 or zero)
-             * by the duty cycle of wave (how long it is high)*/
-            if (dt_us > 50)
-            {
-                done = add_bit(1);
-            }
-            else
-            {
-                done = add_bit(0);
-            }
+/**
+ * Wait until sensor stops sending.
+ * @param tail value of edge counter before transmission
+ * @return number of edges captured
+ */
+static uint32_t wait_for_edges(DhtSensor_t * sensor, uint32_t tail)
+{
+    uint32_t prev = 0;
+    uint32_t count = 0;
+    TickType_t waited;
 
-            if (done)
-            {
-                /* we have 40 bits already.
-                 * inform task and stop reading */
-                s_dht_read_state = E_DHT_RD_IDLE;
-                xQueueSendFromISR(evt_queue, (uint32_t *) &s_prev_time, NULL);
-            }
+    for (waited = 0; waited <= (DHT_READ_TIMEOUT_MS / portTICK_PERIOD_MS); ++waited)
+    {
+        vTaskDelay(1);
+        count = sensor->head - tail;
+
+        if ((count >= DHT_EDGE_COUNT) || (count && (count == prev)))
+        {
+            /* everything expected came or signal went quiet */
+            break;
         }
+        prev = count;
     }
-}
 
-void humtemp_init(void)
-{
-    /* enable per-pin GPIO interrupts */
-    gpio_install_isr_service(0);
-    /* create queue. we only need it for waking main
-     * task when, DHT read is completed */
-    evt_queue = xQueueCreate(2, sizeof(uint32_t));
-    /* minimal delay from POWER ON till DHT ready
-     * can be deleted if this delay is insured by logic
-     * somewhere else */
-    vTaskDelay(2500 / portTICK_RATE_MS);
+    return count;
 }
 
-
-int humtemp_read(Humidity_t * humidity, Temperature_t * temperature)
+int humtemp_read(int channel, Humidity_t * humidity, Temperature_t * temperature)
 {
     int result = HT_E_UNKNOWN;
-    uint32_t dummy;
+    DhtSensor_t * sensor;
+    uint8_t dat[DHT_DATA_BYTES];
+    uint32_t tail;
+    uint32_t count;
+    int64_t start_us;
 
-    s_dht_read_state = E_DHT_RD_START;
+    if ((channel < 0) || (channel >= HUMTEMP_CHANNELS))
+    {
+        return HT_E_UNKNOWN;
+    }
+    sensor = &s_sensors[channel];
+
+    wait_ready(sensor);
+    start_us = esp_timer_get_time();
+    ++sensor->stats.reads;
+
+    /* CPU clock must stay the same while we count ticks */
+    power_freq_hold();
+    s_ticks_per_us = power_cpu_mhz();
 
     /* request transmission, by forcing DHT's DATA pin LOW */
-    set_output();
-    gpio_set_level(DHT_DATA_PIN, 0);
+    set_output(sensor->pin);
+    gpio_set_level(sensor->pin, 0);
     /* transmission request must last at least 18 milliseconds */
     vTaskDelay(10 / portTICK_RATE_MS);
 
     /* prepare for interrupt-based data capture from DHT */
-    gpio_isr_handler_add(DHT_DATA_PIN, gpio_isr_handler, NULL);
-    /* save time when transaction started */
-    s_prev_time = asm_ccount();
-    set_input(); // reconfiguring pin will bring it back HIGH (pull up)
-
-    /* Wait for data read to be complete.
-     * Wait for maximum of 1 second. */
-    if (xQueueReceive(evt_queue, &dummy, 1000 / portTICK_PERIOD_MS))
+    tail = sensor->head;
+    set_input(sensor->pin); // reconfiguring pin will bring it back HIGH (pull up)
+
+    count = wait_for_edges(sensor, tail);
+
+    /* Interrupt can be disabled now */
+    gpio_set_intr_type(sensor->pin, GPIO_INTR_DISABLE);
+    power_freq_release();
+
+    if (count > DHT_EDGE_RING_SIZE)
+    {
+        /* oldest ones are overwritten */
+        tail += count - DHT_EDGE_RING_SIZE;
+        count = DHT_EDGE_RING_SIZE;
+    }
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        s_capture[i] = sensor->edges[(tail + i) & (DHT_EDGE_RING_SIZE - 1)];
+    }
+    sensor->stats.last_edges = count;
+
+#ifdef DHT_TRACE
+    /* capture as line of test/dht_decode trace file */
+    DBG_PRINTF("DHT %u", s_ticks_per_us);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        DBG_PRINTF(" %x", s_capture[i]);
+    }
+    DBG_PRINTF("\n");
+#endif
+
+    if (DHT_DECODE_OK == dht_decode(s_capture, count, s_ticks_per_us, dat))
     {
         /* verify read data by checksum */
-        if ((255 & (s_read.dat[0] + s_read.dat[1] + s_read.dat[2] + s_read.dat[3])) == s_read.dat[4])
+        if ((255 & (dat[0] + dat[1] + dat[2] + dat[3])) == dat[4])
         {
-            int T_sign = s_read.dat[2] & 0x80;
+            int T_sign = dat[2] & 0x80;
 
-            *humidity = (((uint16_t) s_read.dat[0]) << 8) | (uint16_t) s_read.dat[1];
-            *temperature = (((uint16_t) (s_read.dat[2] & 0x7F)) << 8) | (uint16_t) s_read.dat[3];
+            *humidity = (((uint16_t) dat[0]) << 8) | (uint16_t) dat[1];
+            *temperature = (((uint16_t) (dat[2] & 0x7F)) << 8) | (uint16_t) dat[3];
             if (T_sign)
             {
                 *temperature = 0 - *temperature;
             }
 
-            ESP_LOGI(TAG, "RH=%02X %02X  T=%02X %02X  \n", (unsigned) s_read.dat[0], (unsigned) s_read.dat[1],
-                    (unsigned) s_read.dat[2], (unsigned) s_read.dat[3]);
+            ESP_LOGI(TAG, "%d: RH=%02X %02X  T=%02X %02X  \n", channel, (unsigned) dat[0], (unsigned) dat[1],
+                    (unsigned) dat[2], (unsigned) dat[3]);
             result = HT_SUCCESS;
+            ++sensor->stats.ok;
         }
         else
         {
-            ESP_LOGW(TAG, "CHECKSUM ERROR: %d+%d+%d+%d=%d NOT %d",(int) s_read.dat[0],
-                    (int) s_read.dat[1], (int) s_read.dat[2], (int) s_read.dat[3],
-                    (int) (155 & (s_read.dat[0] + s_read.dat[1] + s_read.dat[2] + s_read.dat[3])),
-                    (int) s_read.dat[4]);
+            ESP_LOGW(TAG, "%d: CHECKSUM ERROR: %d+%d+%d+%d=%d NOT %d", channel, (int) dat[0],
+                    (int) dat[1], (int) dat[2], (int) dat[3],
+                    (int) (255 & (dat[0] + dat[1] + dat[2] + dat[3])),
+                    (int) dat[4]);
             result = HT_E_CHECKSUM;
+            ++sensor->stats.checksum_errors;
         }
     }
     else
     {
-        ESP_LOGW(TAG, "Read timed out.");
+        ESP_LOGW(TAG, "%d: Read timed out (%u edges).", channel, count);
         result = HT_E_TIMEOUT;
+        ++sensor->stats.timeouts;
     }
 
-    /* Interrupt can be disabled now */
-    gpio_isr_handler_remove(DHT_DATA_PIN);
-    gpio_set_intr_type(DHT_DATA_PIN, GPIO_INTR_DISABLE);
+    sensor->stats.last_latency_us = (uint32_t) (esp_timer_get_time() - start_us);
 
     return result;
 }
+
+void humtemp_stats(int channel, HumTempStats_t * stats)
+{
+    if ((channel >= 0) && (channel < HUMTEMP_CHANNELS))
+    {
+        *stats = s_sensors[channel].stats;
+    }
+}
+
+#endif /* HUMTEMP_I2C */
@@ -12,6 +12,21 @@
 
 #include <stdint.h>
 
+/*
+ * Sensor interface is chosen at build time:
+ *  - default: single-wire DHT protocol (humtemp.c),
+ *  - HUMTEMP_I2C defined: AM2322 over I2C (humtemp_i2c.c).
+ * See main/component.mk.
+ */
+
+/**
+ * Number of sensors connected (channels), each on its own GPIO
+ * (see DHT_DATA_PINS in humtemp.c). Up to 4.
+ */
+#ifndef HUMTEMP_CHANNELS
+#define HUMTEMP_CHANNELS    1
+#endif
+
 #define HT_SUCCESS      0   /**< Successful reading. */
 #define HT_E_TIMEOUT    1   /**< Error - timeout when waiting for data. */
 #define HT_E_CHECKSUM   2   /**< Error - checksum error, data corrupted. */
@@ -25,18 +40,51 @@ typedef uint16_t DHT_fixedpoint;
 typedef DHT_fixedpoint Humidity_t;      /**< Humidity reading type. */
 typedef DHT_fixedpoint Temperature_t;   /**< Temperature reading type. */
 
+/**
+ * Reading statistics, for checking reliability of sensor link.
+ */
+typedef struct
+{
+    uint32_t reads;             /**< All reads started. */
+    uint32_t ok;                /**< Successful reads. */
+    uint32_t checksum_errors;   /**< Reads with bad checksum. */
+    uint32_t timeouts;          /**< Reads with not enough data. */
+    uint32_t last_latency_us;   /**< Duration of last read [us]. */
+    uint32_t last_edges;        /**< Edges captured in last read. */
+} HumTempStats_t;
+
+/**
+ * Time from sensor power on till it can be read [ms].
+ */
+#define HT_POWERUP_MS       2500
+/**
+ * Minimal time between two reads [ms].
+ */
+#define HT_MIN_INTERVAL_MS  2000
+
 /**
  * Initialize module.
- * WARNING: sleeps for 1 second.
+ * Does not wait for sensor - first read waits till power-up
+ * time passes (only after cold boot, during deep sleep sensor
+ * stays powered and is ready right after wake-up).
  */
 void humtemp_init(void);
 /**
  * Perform reading.
+ * Waits if sensor is not ready yet (power-up time or minimal
+ * interval since previous read of this sensor).
+ * @param channel index of sensor
  * @param humidity pointer to where store humidity reading
  * @param temperature pointer to where store temperature reading
  * @returns result code (0 on success)
  */
-int humtemp_read(Humidity_t * humidity, Temperature_t * temperature);
+int humtemp_read(int channel, Humidity_t * humidity, Temperature_t * temperature);
+/**
+ * Get reading statistics since humtemp_init().
+ * @param channel index of sensor
+ * @param stats output
+ */
+void humtemp_stats(int channel, HumTempStats_t * stats);
 
 
 #endif /* MAIN_HUMTEMP_H_ */
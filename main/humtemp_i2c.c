@@ -0,0 +1,261 @@
+/**
+ * Driver for reading from AM2322 temperature and humidity sensor over I2C.
+ * humtemp_i2c.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "humtemp.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "rom/ets_sys.h"
+
+#ifdef HUMTEMP_I2C
+
+#if HUMTEMP_CHANNELS > 1
+#error "AM2322 has fixed I2C address, only one sensor can be connected"
+#endif
+
+#include "driver/i2c.h"
+
+/**
+ * GPIO used for SDA (same as single-wire data pin).
+ */
+#define AM_SDA_PIN      2
+/**
+ * GPIO used for SCL.
+ */
+#define AM_SCL_PIN      0
+
+#define AM_I2C_PORT     I2C_NUM_0
+/**
+ * 7-bit address of AM2322.
+ */
+#define AM_ADDRESS      0x5C
+/**
+ * Read registers function code.
+ */
+#define AM_FUNC_READ    0x03
+/**
+ * First register of humidity and temperature.
+ */
+#define AM_REG_HUMIDITY 0x00
+/**
+ * Bytes of response to read of 4 registers:
+ * function, count, 4 bytes data, 2 bytes CRC.
+ */
+#define AM_RESPONSE_LEN 8
+
+/**
+ * Prefix for E_LOG.
+ */
+static const char *TAG = "HumTempI2C";
+
+/**
+ * Read statistics.
+ */
+static HumTempStats_t s_stats;
+/**
+ * Time when sensor can be read again [us since boot].
+ */
+static int64_t s_ready_us;
+
+static void bus_init(void)
+{
+    i2c_config_t conf;
+
+    conf.mode = I2C_MODE_MASTER;
+    conf.sda_io_num = AM_SDA_PIN;
+    conf.sda_pullup_en = GPIO_PULLUP_ENABLE;
+    conf.scl_io_num = AM_SCL_PIN;
+    conf.scl_pullup_en = GPIO_PULLUP_ENABLE;
+    conf.clk_stretch_tick = 300;
+    i2c_driver_install(AM_I2C_PORT, conf.mode);
+    i2c_param_config(AM_I2C_PORT, &conf);
+}
+
+/**
+ * Wake sensor up. It does not acknowledge its address when asleep.
+ */
+static int bus_wake(void)
+{
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (AM_ADDRESS << 1) | I2C_MASTER_WRITE, false);
+    i2c_master_stop(cmd);
+    i2c_master_cmd_begin(AM_I2C_PORT, cmd, 10 / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
+
+    return 0;
+}
+
+static int bus_write(uint8_t * data, int len)
+{
+    esp_err_t err;
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (AM_ADDRESS << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_write(cmd, data, len, true);
+    i2c_master_stop(cmd);
+    err = i2c_master_cmd_begin(AM_I2C_PORT, cmd, 10 / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
+
+    return (ESP_OK == err) ? 0 : -1;
+}
+
+static int bus_read(uint8_t * data, int len)
+{
+    esp_err_t err;
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (AM_ADDRESS << 1) | I2C_MASTER_READ, true);
+    i2c_master_read(cmd, data, len, I2C_MASTER_LAST_NACK);
+    i2c_master_stop(cmd);
+    err = i2c_master_cmd_begin(AM_I2C_PORT, cmd, 10 / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
+
+    return (ESP_OK == err) ? 0 : -1;
+}
+
+
+/**
+ * CRC-16 used by AM2322 (Modbus: poly 0xA001 reflected, init 0xFFFF).
+ */
+static uint16_t crc16(const uint8_t * data, int len)
+{
+    uint16_t crc = 0xFFFF;
+
+    while (len--)
+    {
+        crc ^= *data++;
+        for (int i = 0; i < 8; ++i)
+        {
+            if (crc & 1)
+            {
+                crc = (crc >> 1) ^ 0xA001;
+            }
+            else
+            {
+                crc >>= 1;
+            }
+        }
+    }
+    return crc;
+}
+
+/**
+ * Wait until sensor can be read, reserve time of next read.
+ */
+static void wait_ready(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (now < s_ready_us)
+    {
+        vTaskDelay((uint32_t) ((s_ready_us - now) / 1000) / portTICK_RATE_MS + 1);
+        now = esp_timer_get_time();
+    }
+    s_ready_us = now + HT_MIN_INTERVAL_MS * 1000LL;
+}
+
+void humtemp_init(void)
+{
+    bus_init();
+    memset(&s_stats, 0, sizeof(s_stats));
+    /* after deep sleep sensor was powered all the time,
+     * after cold boot it needs time to start (counted from boot) */
+    s_ready_us = (ESP_RST_DEEPSLEEP == esp_reset_reason()) ? 0 : (HT_POWERUP_MS * 1000LL);
+}
+
+int humtemp_read(int channel, Humidity_t * humidity, Temperature_t * temperature)
+{
+    int result = HT_E_UNKNOWN;
+    uint8_t request[3] = { AM_FUNC_READ, AM_REG_HUMIDITY, 4 };
+    uint8_t dat[AM_RESPONSE_LEN];
+    int64_t start_us;
+
+    if (0 != channel)
+    {
+        return HT_E_UNKNOWN;
+    }
+
+    wait_ready();
+    start_us = esp_timer_get_time();
+    ++s_stats.reads;
+
+    bus_wake();
+    /* at least 800us for sensor to wake up */
+    ets_delay_us(1000);
+
+    if (bus_write(request, sizeof(request)))
+    {
+        ESP_LOGW(TAG, "No response.");
+        result = HT_E_TIMEOUT;
+        ++s_stats.timeouts;
+    }
+    else
+    {
+        /* at least 1.5ms for measurement */
+        ets_delay_us(2000);
+
+        if (bus_read(dat, sizeof(dat)))
+        {
+            ESP_LOGW(TAG, "Read failed.");
+            result = HT_E_TIMEOUT;
+            ++s_stats.timeouts;
+        }
+        else if ((dat[0] != AM_FUNC_READ) || (dat[1] != 4))
+        {
+            ESP_LOGW(TAG, "Unexpected response %02X %02X", (unsigned) dat[0], (unsigned) dat[1]);
+            result = HT_E_UNKNOWN;
+        }
+        else if (crc16(dat, 6) != (((uint16_t) dat[7] << 8) | dat[6]))
+        {
+            ESP_LOGW(TAG, "CRC ERROR");
+            result = HT_E_CHECKSUM;
+            ++s_stats.checksum_errors;
+        }
+        else
+        {
+            int T_sign = dat[4] & 0x80;
+
+            *humidity = (((uint16_t) dat[2]) << 8) | (uint16_t) dat[3];
+            *temperature = (((uint16_t) (dat[4] & 0x7F)) << 8) | (uint16_t) dat[5];
+            if (T_sign)
+            {
+                *temperature = 0 - *temperature;
+            }
+
+            ESP_LOGI(TAG, "RH=%02X %02X  T=%02X %02X  \n", (unsigned) dat[2], (unsigned) dat[3],
+                    (unsigned) dat[4], (unsigned) dat[5]);
+            result = HT_SUCCESS;
+            ++s_stats.ok;
+        }
+    }
+
+    s_stats.last_latency_us = (uint32_t) (esp_timer_get_time() - start_us);
+
+    return result;
+}
+
+void humtemp_stats(int channel, HumTempStats_t * stats)
+{
+    if (0 == channel)
+    {
+        *stats = s_stats;
+    }
+}
+
+#endif /* HUMTEMP_I2C */
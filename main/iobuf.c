@@ -0,0 +1,156 @@
+/*
+ * Shared arena of network I/O buffers.
+ * iobuf.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "iobuf.h"
+
+#define IOBUF_ALIGN     4
+
+static const char * TAG = "iobuf";
+
+typedef struct
+{
+    size_t offset;
+    size_t size;        /**< 0 - not leased. */
+} IobufLease_t;
+
+static char * s_arena = NULL;
+static size_t s_arena_size = 0;
+/**
+ * Number of iobuf_open() calls not closed yet.
+ */
+static int s_open_count = 0;
+static IobufLease_t s_leases[IOBUF_OWNERS];
+
+/**
+ * Check if part of arena is not leased.
+ */
+static int iobuf_free(size_t offset, size_t size)
+{
+    for (int o = 0; o < IOBUF_OWNERS; ++o)
+    {
+        const IobufLease_t * l = &s_leases[o];
+
+        if (l->size && (offset < l->offset + l->size) && (l->offset < offset + size))
+        {
+            return 0;
+        }
+    }
+    return offset + size <= s_arena_size;
+}
+
+int iobuf_open(size_t size)
+{
+    if (s_open_count)
+    {
+        if (size > s_arena_size)
+        {
+            ESP_LOGE(TAG, "arena of %u B open, %u B needed", s_arena_size, size);
+            return -1;
+        }
+        ++s_open_count;
+        return 0;
+    }
+
+    s_arena = malloc(size);
+    if (NULL == s_arena)
+    {
+        ESP_LOGE(TAG, "no memory for arena of %u B", size);
+        return -1;
+    }
+    s_arena_size = size;
+    s_open_count = 1;
+    memset(s_leases, 0, sizeof(s_leases));
+    return 0;
+}
+
+void iobuf_close(void)
+{
+    if ((0 == s_open_count) || --s_open_count)
+    {
+        return;
+    }
+
+    for (int o = 0; o < IOBUF_OWNERS; ++o)
+    {
+        if (s_leases[o].size)
+        {
+            ESP_LOGE(TAG, "owner %d leaked %u B", o, s_leases[o].size);
+        }
+    }
+    memset(s_leases, 0, sizeof(s_leases));
+    free(s_arena);
+    s_arena = NULL;
+    s_arena_size = 0;
+}
+
+void * iobuf_lease(IobufOwner_t owner, size_t size)
+{
+    size_t best = s_arena_size;
+
+    if ((owner >= IOBUF_OWNERS) || (NULL == s_arena) || s_leases[owner].size || (0 == size))
+    {
+        ESP_LOGE(TAG, "owner %d can not lease %u B", owner, size);
+        return NULL;
+    }
+    size = (size + IOBUF_ALIGN - 1) & ~(IOBUF_ALIGN - 1);
+
+    /* lowest free place: start of arena or end of some lease */
+    if (iobuf_free(0, size))
+    {
+        best = 0;
+    }
+    for (int o = 0; o < IOBUF_OWNERS; ++o)
+    {
+        size_t offset = s_leases[o].offset + s_leases[o].size;
+
+        if (s_leases[o].size && (offset < best) && iobuf_free(offset, size))
+        {
+            best = offset;
+        }
+    }
+
+    if (best == s_arena_size)
+    {
+        ESP_LOGE(TAG, "no room for %u B of owner %d", size, owner);
+        return NULL;
+    }
+
+    s_leases[owner].offset = best;
+    s_leases[owner].size = size;
+    return &s_arena[best];
+}
+
+int iobuf_release(IobufOwner_t owner, void * buf)
+{
+    if ((owner >= IOBUF_OWNERS) || (0 == s_leases[owner].size)
+            || (buf != &s_arena[s_leases[owner].offset]))
+    {
+        ESP_LOGE(TAG, "owner %d does not hold %p", owner, buf);
+        return -1;
+    }
+    s_leases[owner].size = 0;
+    return 0;
+}
+
+void * iobuf_get(IobufOwner_t owner, size_t * size)
+{
+    if ((owner >= IOBUF_OWNERS) || (0 == s_leases[owner].size))
+    {
+        return NULL;
+    }
+    if (NULL != size)
+    {
+        *size = s_leases[owner].size;
+    }
+    return &s_arena[s_leases[owner].offset];
+}
@@ -0,0 +1,62 @@
+/*
+ * Shared arena of network I/O buffers.
+ * Buffers of phases that never overlap (request build, response parse)
+ * take the same memory, OTA staging takes the rest. Arena is taken
+ * from heap only for time of network work. Used by one task only.
+ * iobuf.h
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#ifndef MAIN_IOBUF_H_
+#define MAIN_IOBUF_H_
+
+#include <stddef.h>
+
+/**
+ * Users of arena, each holds at most one lease at a time.
+ */
+typedef enum
+{
+    IOBUF_REQUEST = 0,      /**< HTTP request being built and sent. */
+    IOBUF_RESPONSE,         /**< Receive buffer of response. */
+    IOBUF_OTA_SECTOR,       /**< Staging of flash sector. */
+    IOBUF_OTA_DECODER,      /**< State of image decoders. */
+    IOBUF_OWNERS
+} IobufOwner_t;
+
+/**
+ * Make arena of at least given size available.
+ * Calls can be nested (OTA opens arena for itself and client,
+ * client just uses it), each must be paired with iobuf_close().
+ * @param size needed size [B], must not be bigger than size of
+ * already open arena
+ * @return 0 on success
+ */
+int iobuf_open(size_t size);
+/**
+ * End use of arena. Memory goes back to heap with last close,
+ * leases still held then are reported as leaked.
+ */
+void iobuf_close(void);
+/**
+ * Take part of arena.
+ * @return buffer (4-byte aligned) or NULL if arena is not open,
+ * there is no room or owner already holds lease
+ */
+void * iobuf_lease(IobufOwner_t owner, size_t size);
+/**
+ * Give lease back.
+ * @param buf buffer got from iobuf_lease
+ * @return 0 on success, -1 if buf is not leased by owner
+ */
+int iobuf_release(IobufOwner_t owner, void * buf);
+/**
+ * Buffer leased by owner.
+ * @param size if not NULL, receives size of lease
+ * @return buffer or NULL if owner holds no lease
+ */
+void * iobuf_get(IobufOwner_t owner, size_t * size);
+
+#endif /* MAIN_IOBUF_H_ */
@@ -6,107 +6,550 @@
  *      Author: andrzej
  */
 
-#include <stdlib.h>
+#include <string.h>
 
 #include "measurements.h"
-#include "esp_log.h"
+#include "rtc.h"
 
+/**
+ * Below that many values selection is done by insertion sort.
+ */
+#define SELECT_SMALL    8
+
+/**
+ * Samples further from median than that many MADs
+ * are dropped by MEAS_EST_MAD.
+ */
+#define MAD_LIMIT       3
+
+/**
+ * Number of markers of P-square estimator.
+ */
+#define P2_MARKERS      5
+
+/**
+ * Flag of deadband RTC word telling that its channel reported
+ * a value already (channel bits are not needed there, word is per channel).
+ */
+#define DB_REPORTED     (1UL << 31)
+
+#if MEAS_MAX_SAMPLES < P2_MARKERS
+#error "MEAS_MAX_SAMPLES too small"
+#endif
+
+/**
+ * State of streaming median estimator (P-square algorithm,
+ * Jain & Chlamtac 1985). Constant memory for any number of samples.
+ */
 typedef struct {
-    uint16_t h;
-    uint16_t t;
-} Sample_t;
+    float q[P2_MARKERS];        /**< marker heights */
+    float np[P2_MARKERS];       /**< desired marker positions */
+    int32_t n[P2_MARKERS];      /**< actual marker positions */
+    uint32_t count;
+} P2_t;
 
-static Sample_t * s_buf = NULL;
-static uint32_t s_idx;
-static uint32_t s_total;
+/**
+ * Samples of one sensor. Humidity and temperature are kept
+ * in separate arrays, so each can be reordered by selection
+ * on its own. Values are signed (temperature can be negative).
+ * When arrays are full, their content is moved to streaming
+ * estimators.
+ */
+typedef struct {
+    int16_t h[MEAS_MAX_SAMPLES];
+    int16_t t[MEAS_MAX_SAMPLES];
+    uint32_t idx;               /**< samples added */
+    int16_t last_h, last_t;     /**< last sample */
+    int16_t prev_h, prev_t;     /**< sample before last */
+    P2_t p2_h, p2_t;
+} Channel_t;
+
+static Channel_t s_channels[HUMTEMP_CHANNELS];
+static int16_t s_scratch[MEAS_MAX_SAMPLES];
+static MeasEstimator_t s_estimator;
+
+static int16_t sample_convert(DHT_fixedpoint sample)
+{
+    return (int16_t) (sample * 10);
+}
 
-static uint16_t sample_convert(DHT_fixedpoint sample)
+static void measurement_reset(Channel_t * c)
 {
-    return sample * 10;
+    c->idx = 0;
 }
 
 void measurement_init(const GniotConfig_t * cfg)
 {
-    s_idx = 0;
-    s_total = cfg->samples_per_measure;
+    s_estimator = (cfg->estimator < MEAS_EST_COUNT) ? cfg->estimator : MEAS_EST_MEDIAN;
 
-    if (s_buf)
+    for (int ch = 0; ch < HUMTEMP_CHANNELS; ++ch)
     {
-        free(s_buf);
+        measurement_reset(&s_channels[ch]);
     }
+}
 
-    s_buf = malloc(sizeof(Sample_t) * s_total);
+/**
+ * Add value to streaming median estimator.
+ */
+static void p2_add(P2_t * p, float x)
+{
+    static const float dn[P2_MARKERS] = { 0.0f, 0.25f, 0.5f, 0.75f, 1.0f };
+    int k;
+
+    if (p->count < P2_MARKERS)
+    {
+        /* first values are just kept sorted */
+        for (k = p->count; (k > 0) && (p->q[k - 1] > x); --k)
+        {
+            p->q[k] = p->q[k - 1];
+        }
+        p->q[k] = x;
+
+        if (++p->count == P2_MARKERS)
+        {
+            for (k = 0; k < P2_MARKERS; ++k)
+            {
+                p->n[k] = k;
+                p->np[k] = 4.0f * dn[k];
+            }
+        }
+        return;
+    }
+
+    /* find cell of new value, extend range if needed */
+    if (x < p->q[0])
+    {
+        p->q[0] = x;
+        k = 0;
+    }
+    else if (x >= p->q[P2_MARKERS - 1])
+    {
+        p->q[P2_MARKERS - 1] = x;
+        k = P2_MARKERS - 2;
+    }
+    else
+    {
+        for (k = 0; x >= p->q[k + 1]; ++k);
+    }
+
+    for (int i = k + 1; i < P2_MARKERS; ++i)
+    {
+        ++p->n[i];
+    }
+    for (int i = 0; i < P2_MARKERS; ++i)
+    {
+        p->np[i] += dn[i];
+    }
+    ++p->count;
+
+    /* move middle markers towards desired positions */
+    for (int i = 1; i < P2_MARKERS - 1; ++i)
+    {
+        float d = p->np[i] - p->n[i];
+
+        if (((d >= 1.0f) && (p->n[i + 1] - p->n[i] > 1))
+                || ((d <= -1.0f) && (p->n[i - 1] - p->n[i] < -1)))
+        {
+            int s = (d > 0) ? 1 : -1;
+            float qp = p->q[i] + (float) s / (p->n[i + 1] - p->n[i - 1])
+                    * ((p->n[i] - p->n[i - 1] + s) * (p->q[i + 1] - p->q[i]) / (p->n[i + 1] - p->n[i])
+                    + (p->n[i + 1] - p->n[i] - s) * (p->q[i] - p->q[i - 1]) / (p->n[i] - p->n[i - 1]));
+
+            if ((p->q[i - 1] < qp) && (qp < p->q[i + 1]))
+            {
+                /* parabolic prediction */
+                p->q[i] = qp;
+            }
+            else
+            {
+                /* linear prediction */
+                p->q[i] += s * (p->q[i + s] - p->q[i]) / (p->n[i + s] - p->n[i]);
+            }
+            p->n[i] += s;
+        }
+    }
+}
+
+static int16_t p2_median(const P2_t * p)
+{
+    float m = p->q[P2_MARKERS / 2];
+    return (int16_t) ((m < 0) ? (m - 0.5f) : (m + 0.5f));
+}
+
+void measurement_add_sample(int channel, Humidity_t h, Temperature_t t)
+{
+    Channel_t * c = &s_channels[channel];
+    int16_t sh = sample_convert(h);
+    int16_t st = sample_convert(t);
+
+    c->prev_h = c->last_h;
+    c->prev_t = c->last_t;
+    c->last_h = sh;
+    c->last_t = st;
+
+    if (c->idx < MEAS_MAX_SAMPLES)
+    {
+        c->h[c->idx] = sh;
+        c->t[c->idx] = st;
+    }
+    else
+    {
+        if (c->idx == MEAS_MAX_SAMPLES)
+        {
+            /* out of memory for samples - switch to streaming */
+            memset(&c->p2_h, 0, sizeof(c->p2_h));
+            memset(&c->p2_t, 0, sizeof(c->p2_t));
+            for (int i = 0; i < MEAS_MAX_SAMPLES; ++i)
+            {
+                p2_add(&c->p2_h, c->h[i]);
+                p2_add(&c->p2_t, c->t[i]);
+            }
+        }
+        p2_add(&c->p2_h, sh);
+        p2_add(&c->p2_t, st);
+    }
+    ++c->idx;
+}
+
+static uint16_t sample_diff(int16_t a, int16_t b)
+{
+    int32_t d = (int32_t) a - b;
+    return (d < 0) ? -d : d;
+}
+
+bool measurement_converged(int channel, uint16_t tolerance)
+{
+    const Channel_t * c = &s_channels[channel];
+    uint16_t limit = (uint16_t) sample_convert(tolerance);
+
+    if ((0 == tolerance) || (c->idx < 2))
+    {
+        return false;
+    }
+
+    return (sample_diff(c->last_h, c->prev_h) <= limit)
+            && (sample_diff(c->last_t, c->prev_t) <= limit);
+}
+
+static inline void swap(int16_t * a, int16_t * b)
+{
+    int16_t tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+/**
+ * Partially order array, so that element with rank k is at index k,
+ * all smaller before and all greater after it (quickselect).
+ * Expected time is linear in n.
+ * @return value of k-th smallest element
+ */
+static int16_t select_kth(int16_t * a, uint32_t n, uint32_t k)
+{
+    uint32_t lo = 0;
+    uint32_t hi = n - 1;
+
+    while (hi - lo >= SELECT_SMALL)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t i, j;
+        int16_t pivot;
+
+        /* median of three as pivot, sentinels at both ends */
+        if (a[mid] < a[lo]) swap(&a[mid], &a[lo]);
+        if (a[hi] < a[lo]) swap(&a[hi], &a[lo]);
+        if (a[hi] < a[mid]) swap(&a[hi], &a[mid]);
+        pivot = a[mid];
+        swap(&a[mid], &a[lo + 1]);
+
+        /* Hoare partition of (lo + 1, hi) */
+        i = lo + 1;
+        j = hi;
+        while (1)
+        {
+            while (a[++i] < pivot);
+            while (a[--j] > pivot);
+            if (j < i)
+            {
+                break;
+            }
+            swap(&a[i], &a[j]);
+        }
+        a[lo + 1] = a[j];
+        a[j] = pivot;
+
+        if (j == k)
+        {
+            return pivot;
+        }
+        if (j < k)
+        {
+            lo = j + 1;
+        }
+        else
+        {
+            hi = j - 1;
+        }
+    }
 
-    if (!s_buf)
+    /* short range - just sort it */
+    for (uint32_t i = lo + 1; i <= hi; ++i)
     {
-        ESP_LOGE("meas", "Memory alloc error\n");
-        abort();
+        for (uint32_t j = i; (j > lo) && (a[j - 1] > a[j]); --j)
+        {
+            swap(&a[j], &a[j - 1]);
+        }
     }
+
+    return a[k];
 }
 
-void measurement_add_sample(Humidity_t h, Temperature_t t)
+/**
+ * Rounded mean of n values.
+ */
+static int16_t mean(int32_t sum, uint32_t n)
 {
-    uint16_t sh = sample_convert(h);
-    uint16_t st = sample_convert(t);
-    s_buf[s_idx].h = sh;
-    s_buf[s_idx].t = st;
-    ++s_idx;
+    int32_t half = (int32_t) n / 2;
+    return (int16_t) ((sum + ((sum < 0) ? -half : half)) / (int32_t) n);
 }
 
-static void measurement_reset(void)
+/**
+ * Mean of samples remaining after dropping n/4 lowest and n/4 highest.
+ */
+static int16_t trimmed_mean(int16_t * a, uint32_t n)
 {
-    s_idx = 0;
+    uint32_t trim = n / 4;
+    uint32_t keep = n - 2 * trim;
+    int32_t sum = 0;
+
+    if (trim)
+    {
+        /* lowest trim before index trim, then highest trim after keep middle ones */
+        select_kth(a, n, trim);
+        select_kth(a + trim, n - trim, keep - 1);
+    }
+
+    for (uint32_t i = trim; i < trim + keep; ++i)
+    {
+        sum += a[i];
+    }
+
+    return mean(sum, keep);
 }
 
-static void sort_buf(void)
+/**
+ * Mean of samples not further than MAD_LIMIT median absolute deviations
+ * from median.
+ */
+static int16_t mad_mean(int16_t * a, uint32_t n)
 {
-    for (int i = 1; i < s_idx; ++i)
+    int16_t med = select_kth(a, n, n / 2);
+    uint32_t limit;
+    uint32_t count = 0;
+    int32_t sum = 0;
+
+    for (uint32_t i = 0; i < n; ++i)
     {
-        for (int j = i; (j > 0) && (s_buf[j-1].h > s_buf[j].h); --j)
+        s_scratch[i] = (int16_t) sample_diff(a[i], med);
+    }
+    limit = MAD_LIMIT * (uint32_t) select_kth(s_scratch, n, n / 2);
+
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        if (sample_diff(a[i], med) <= limit)
         {
-            Sample_t tmp = s_buf[j];
-            s_buf[j] = s_buf[j - 1];
-            s_buf[j - 1] = tmp;
+            sum += a[i];
+            ++count;
         }
     }
+
+    /* median itself always passes, count > 0 */
+    return mean(sum, count);
 }
 
-int measurement_get(uint32_t * out)
+static int16_t estimate(int16_t * a, uint32_t n)
 {
-    uint32_t sum_h = 0, sum_t = 0;
+    if (n < 3)
+    {
+        /* nothing to filter out */
+        return a[0];
+    }
 
-    if (s_idx == 0)
+    switch (s_estimator)
     {
-        measurement_reset();
+    case MEAS_EST_TRIMMED:
+        return trimmed_mean(a, n);
+    case MEAS_EST_MAD:
+        return mad_mean(a, n);
+    case MEAS_EST_MEDIAN:
+    default:
+        return select_kth(a, n, n / 2);
+    }
+}
+
+int measurement_get(int channel, uint32_t * out)
+{
+    Channel_t * c = &s_channels[channel];
+    uint16_t h, t;
+
+    if (c->idx == 0)
+    {
+        measurement_reset(c);
         return -1;
     }
 
-    if (s_idx > 2)
+    /* every channel is filtered on its own */
+    if (c->idx <= MEAS_MAX_SAMPLES)
     {
-        /* median filter */
-        sort_buf();
-        sum_h = s_buf[s_idx / 2].h;
-        sum_t = s_buf[s_idx / 2].t;
+        h = (uint16_t) estimate(c->h, c->idx);
+        t = (uint16_t) estimate(c->t, c->idx);
     }
     else
     {
-#if 0
-        /* simple average */
-        int i;
-        for (i = 0; i < s_idx; ++i)
+        h = (uint16_t) p2_median(&c->p2_h);
+        t = (uint16_t) p2_median(&c->p2_t);
+    }
+
+    *out = SAMPLE_WITH_CHANNEL((((uint32_t) h) << 16) | t, channel);
+    measurement_reset(c);
+    return 0;
+}
+
+/**
+ * Aggregation of measurements of one channel.
+ */
+typedef struct {
+    int32_t sum_h, sum_t;
+    int16_t min_h, min_t;
+    int16_t max_h, max_t;
+    uint16_t count;
+} Window_t;
+
+static Window_t s_windows[HUMTEMP_CHANNELS];
+
+void measurement_window_reset(void)
+{
+    memset(s_windows, 0, sizeof(s_windows));
+}
+
+void measurement_window_add(uint32_t measurement)
+{
+    uint32_t ch = SAMPLE_CHANNEL(measurement);
+    int16_t h = (int16_t) (SAMPLE_VALUE(measurement) >> 16);
+    int16_t t = (int16_t) (measurement & 0xFFFF);
+    Window_t * w;
+
+    if (ch >= HUMTEMP_CHANNELS)
+    {
+        return;
+    }
+    w = &s_windows[ch];
+
+    if (0 == w->count)
+    {
+        w->min_h = w->max_h = h;
+        w->min_t = w->max_t = t;
+    }
+    else
+    {
+        if (h < w->min_h) w->min_h = h;
+        if (h > w->max_h) w->max_h = h;
+        if (t < w->min_t) w->min_t = t;
+        if (t > w->max_t) w->max_t = t;
+    }
+    w->sum_h += h;
+    w->sum_t += t;
+    ++w->count;
+}
+
+int measurement_window_count(int channel)
+{
+    return s_windows[channel].count;
+}
+
+static uint32_t window_encode(int channel, int16_t h, int16_t t)
+{
+    return SAMPLE_WITH_CHANNEL((((uint32_t) (uint16_t) h) << 16) | (uint16_t) t, channel);
+}
+
+int measurement_window_get(int channel, uint32_t ts, StorageSample_t * out)
+{
+    Window_t * w = &s_windows[channel];
+    int n = 0;
+
+    if (w->count)
+    {
+        out[n].ts = ts;
+        out[n].data = window_encode(channel, mean(w->sum_h, w->count), mean(w->sum_t, w->count));
+        ++n;
+
+        if (w->count > 1)
         {
-            sum_h += s_buf[i].h;
-            sum_t += s_buf[i].t;
+            out[n].ts = SAMPLE_EXT(SAMPLE_EXT_MIN, w->count);
+            out[n].data = window_encode(channel, w->min_h, w->min_t);
+            ++n;
+            out[n].ts = SAMPLE_EXT(SAMPLE_EXT_MAX, w->count);
+            out[n].data = window_encode(channel, w->max_h, w->max_t);
+            ++n;
         }
-        sum_h /= s_idx;
-        sum_t /= s_idx;
-#endif
-        sum_h = s_buf[0].h;
-        sum_t = s_buf[0].t;
     }
 
-    *out = (((uint32_t) sum_h) << 16) | sum_t;
-    measurement_reset();
-    return 0;
+    memset(w, 0, sizeof(*w));
+    return n;
 }
 
+/**
+ * Check if value changed enough since last report.
+ * Zero threshold passes every change.
+ */
+static bool deadband_exceeded(int16_t value, int16_t last, uint16_t threshold)
+{
+    uint16_t diff = sample_diff(value, last);
+
+    return threshold ? (diff >= threshold) : (diff != 0);
+}
+
+bool measurement_deadband_pass(uint32_t measurement, uint32_t ts, const GniotConfig_t * cfg)
+{
+    uint32_t ch = SAMPLE_CHANNEL(measurement);
+    RtcWord_t word = RTC_WORD_DB_VAL0 + ch;
+    uint32_t hb_ts;
+    uint32_t last;
+    bool pass;
+
+    if (((0 == cfg->deadband_h) && (0 == cfg->deadband_t)) || (word > RTC_WORD_DB_VAL1))
+    {
+        return true;
+    }
+
+    /* heartbeat (or first measurement, or time going back):
+     * all channels measured at that time are reported */
+    hb_ts = rtc_word_get(RTC_WORD_DB_TS);
+    if ((0 == hb_ts) || (ts < hb_ts)
+            || (cfg->heartbeat && ((ts - hb_ts) >= (cfg->heartbeat * 60U))))
+    {
+        rtc_word_set(RTC_WORD_DB_TS, ts);
+        hb_ts = ts;
+    }
+
+    last = rtc_word_get(word);
+    pass = (hb_ts == ts) || !(last & DB_REPORTED);
+
+    if (!pass)
+    {
+        int16_t h = (int16_t) (SAMPLE_VALUE(measurement) >> 16);
+        int16_t t = (int16_t) (measurement & 0xFFFF);
+        int16_t last_h = (int16_t) (SAMPLE_VALUE(last) >> 16);
+        int16_t last_t = (int16_t) (last & 0xFFFF);
+
+        pass = deadband_exceeded(h, last_h, (uint16_t) sample_convert(cfg->deadband_h))
+                || deadband_exceeded(t, last_t, (uint16_t) sample_convert(cfg->deadband_t));
+    }
+
+    if (pass)
+    {
+        rtc_word_set(word, SAMPLE_VALUE(measurement) | DB_REPORTED);
+    }
+
+    return pass;
+}
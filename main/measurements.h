@@ -10,25 +10,102 @@
 #ifndef MAIN_MEASUREMENTS_H_
 #define MAIN_MEASUREMENTS_H_
 
+#include <stdbool.h>
+
 #include "humtemp.h"
 #include "storage.h"
 
 /**
- * Initialize measurement.
+ * Most samples kept in memory per channel. With more samples
+ * per measurement, median is estimated in streaming way
+ * (P-square algorithm) regardless of configured estimator.
+ */
+#ifndef MEAS_MAX_SAMPLES
+#define MEAS_MAX_SAMPLES    32
+#endif
+
+/**
+ * How value of measurement is computed from samples.
+ * Humidity and temperature are processed independently.
+ */
+typedef enum {
+    MEAS_EST_MEDIAN = 0,    /**< Median (upper one for even count). */
+    MEAS_EST_TRIMMED = 1,   /**< Mean of middle half of samples. */
+    MEAS_EST_MAD = 2,       /**< Mean of samples within 3 MADs from median. */
+    MEAS_EST_COUNT,
+} MeasEstimator_t;
+
+/**
+ * Initialize measurement (for all channels).
  * @param cfg system configuration
  */
 void measurement_init(const GniotConfig_t * cfg);
 /**
  * Add single sample from sensor.
+ * @param channel index of sensor
  * @param h humidity
  * @param t temperature
  */
-void measurement_add_sample(Humidity_t h, Temperature_t t);
+void measurement_add_sample(int channel, Humidity_t h, Temperature_t t);
+/**
+ * Check if samples collected so far agree with each other.
+ * @param channel index of sensor
+ * @param tolerance maximal difference of last two samples
+ *  [0.1 %RH / 0.1 C] on both channels, 0 - never converged
+ * @return true if more samples are not needed
+ */
+bool measurement_converged(int channel, uint16_t tolerance);
 /**
  * Get processed, encoded value of measurement.
+ * Index of channel is encoded in value, see SAMPLE_CHANNEL.
+ * @param channel index of sensor
  * @param out output buffer
  * @return 0 - success or error code
  */
-int measurement_get(uint32_t * out);
+int measurement_get(int channel, uint32_t * out);
+
+/**
+ * Most samples produced by measurement_window_get().
+ */
+#define MEAS_WINDOW_SAMPLES 3
+
+/**
+ * Start new aggregation window (for all channels).
+ */
+void measurement_window_reset(void);
+/**
+ * Add measurement to aggregation window of its channel.
+ * @param measurement encoded measurement (from measurement_get)
+ */
+void measurement_window_add(uint32_t measurement);
+/**
+ * Number of measurements in aggregation window of channel.
+ */
+int measurement_window_count(int channel);
+/**
+ * Get aggregated window of channel and clear it.
+ * Single measurement is returned as is, more of them as sample
+ * with mean value followed by minimum and maximum extensions
+ * (see SAMPLE_EXT).
+ * @param channel index of sensor
+ * @param ts timestamp of mean sample
+ * @param out output for up to MEAS_WINDOW_SAMPLES samples
+ * @return number of samples written
+ */
+int measurement_window_get(int channel, uint32_t ts, StorageSample_t * out);
+
+/**
+ * Deadband filter - check if measurement differs enough from
+ * last reported one to be worth storing (zero threshold
+ * of humidity or temperature passes every change of it).
+ * All channels are reported when heartbeat interval passed.
+ * Only first two channels are filtered (RTC memory holds two
+ * last values), others are always reported.
+ * @param measurement encoded measurement (or mean of window)
+ * @param ts its timestamp
+ * @param cfg system configuration
+ * @return true if measurement should be reported
+ */
+bool measurement_deadband_pass(uint32_t measurement, uint32_t ts, const GniotConfig_t * cfg);
 
 #endif /* MAIN_MEASUREMENTS_H_ */
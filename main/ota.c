@@ -5,222 +5,370 @@
  */
 
 #include "client.h"
+#include "ota_parse.h"
+#include "ota_sector.h"
+#include "ota_decode.h"
+#include "iobuf.h"
 #include "storage.h"
+#include "power.h"
+#include "energy.h"
+#include "debug.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 #include "esp_system.h"
 #include "esp_log.h"
 #include "esp_ota_ops.h"
+#include "esp_spi_flash.h"
+#include "esp_timer.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-typedef enum esp_ota_firm_state {
-    ESP_OTA_INIT = 0,
-    ESP_OTA_PREPARE,
-    ESP_OTA_START,
-    ESP_OTA_RECVED,
-    ESP_OTA_FINISH,
-} esp_ota_firm_state_t;
-
-typedef struct esp_ota_firm {
-    uint8_t             ota_num;
-    uint8_t             update_ota_num;
-
-    esp_ota_firm_state_t    state;
+#if OTA_SECTOR_SIZE != SPI_FLASH_SEC_SIZE
+#error "OTA_SECTOR_SIZE must be flash sector size"
+#endif
+/**
+ * Download progress is saved every that many sectors.
+ */
+#define OTA_CHECKPOINT_SECTORS  16
+/**
+ * Wait for data longer than that [ms] counts as stall.
+ */
+#define OTA_STALL_MS        200
 
-    size_t              content_len;
+static const char * TAG = "ota";
 
-    size_t              read_bytes;
-    size_t              write_bytes;
+static esp_ota_firm_t s_ota_firm;
+static int s_written = 0;
+/**
+ * Partition new image goes to.
+ */
+static const esp_partition_t * s_update = NULL;
+/**
+ * CRC32 of s_written bytes of image.
+ */
+static uint32_t s_crc = 0;
+/**
+ * Saved state of interrupted download.
+ */
+static OtaProgress_t s_progress;
+static bool s_body_started = false;
+/**
+ * Time spent waiting for data, over OTA_STALL_MS at once [us].
+ */
+static uint32_t s_stall_us = 0;
+static int64_t s_last_data_us = 0;
+/**
+ * Statistics of last download are waiting for upload.
+ */
+static bool s_report_pending = false;
 
-    size_t              ota_size;
-    size_t              ota_offset;
+/**
+ * Staging of image into sectors, its buffer is leased for time of download.
+ */
+static OtaSector_t s_sector;
+static esp_err_t s_write_err = ESP_OK;
+static uint32_t s_flash_us = 0;
+static uint32_t s_flash_writes = 0;
+/**
+ * Image deltas are applied against.
+ */
+static const esp_partition_t * s_running = NULL;
 
-    const char          *buf;
-    size_t              bytes;
-} esp_ota_firm_t;
+typedef struct {
+    LzssDecoder_t lzss;
+    DeltaDecoder_t delta;
+} OtaDecoder_t;
 
-static const char * TAG = "ota";
+/**
+ * Decoders of encoded image, leased when needed.
+ */
+static OtaDecoder_t * s_decoder = NULL;
 
-static esp_ota_firm_t s_ota_firm;
-static esp_ota_handle_t s_update_handle;
-static char ota_write_buf[1501];
-static int s_written = 0;
+/**
+ * I/O buffer arena for download: sector staging, decoders
+ * and buffers of client.
+ */
+#define OTA_IOBUF_SIZE      (OTA_SECTOR_SIZE + sizeof(OtaDecoder_t) + CLIENT_IOBUF_SIZE)
 
-static int read_until(const char *buffer, char delim, int len)
+/**
+ * Update CRC32 (IEEE 802.3) with data, 4 bits at a time.
+ */
+static uint32_t crc32_update(uint32_t crc, const uint8_t * data, size_t size)
 {
-//  /*TODO: delim check,buffer check,further: do an buffer length limited*/
-    int i = 0;
-    while (buffer[i] != delim && i < len) {
-        ++i;
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+
+    crc = ~crc;
+    while (size--)
+    {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
     }
-    return i + 1;
+    return ~crc;
 }
 
-bool _esp_ota_firm_parse_http(esp_ota_firm_t *ota_firm, const char *text, size_t total_len, size_t *parse_len)
+static void ota_parse_init(esp_ota_firm_t *ota_firm, const esp_partition_t *update_partition)
 {
-    /* i means current position */
-    int i = 0, i_read_len = 0;
-    char *ptr = NULL, *ptr2 = NULL;
-    char length_str[32];
-
-    while (text[i] != 0 && i < total_len) {
-        if (ota_firm->content_len == 0 && (ptr = (char *)strstr(text, "Content-Length")) != NULL) {
-            ptr += 16;
-            ptr2 = (char *)strstr(ptr, "\r\n");
-            memset(length_str, 0, sizeof(length_str));
-            memcpy(length_str, ptr, ptr2 - ptr);
-            ota_firm->content_len = atoi(length_str);
-            ota_firm->ota_size = ota_firm->content_len / ota_firm->ota_num;
-            ota_firm->ota_offset = ota_firm->ota_size * ota_firm->update_ota_num;
-            printf("parse Content-Length:%d, ota_size %d\n", ota_firm->content_len, ota_firm->ota_size);
-        }
-
-        i_read_len = read_until(&text[i], '\n', total_len - i);
-
-        if (i_read_len > total_len - i) {
-            ESP_LOGE(TAG, "recv malformed http header");
-        }
-
-        // if resolve \r\n line, http header is finished
-        if (i_read_len == 2) {
-            if (ota_firm->content_len == 0) {
-                ESP_LOGE(TAG, "did not parse Content-Length item");
-            }
+    esp_ota_firm_init(ota_firm, get_ota_partition_count(),
+            update_partition->subtype - ESP_PARTITION_SUBTYPE_APP_OTA_0);
 
-            *parse_len = i + 2;
+    ESP_LOGI(TAG, "Totoal OTA number %d update to %d part", ota_firm->ota_num, ota_firm->update_ota_num);
+}
 
-            return true;
-        }
+/**
+ * Write to update partition. Writes start at sector boundary,
+ * sectors are erased just before, so part written before
+ * interrupted download stays untouched.
+ */
+static esp_err_t partition_write(size_t offset, const void * data, size_t size)
+{
+    size_t erase = (size + OTA_SECTOR_SIZE - 1) & ~(OTA_SECTOR_SIZE - 1);
+    esp_err_t err;
 
-        i += i_read_len;
+    if ((offset % OTA_SECTOR_SIZE) || (offset + erase > s_update->size))
+    {
+        return ESP_FAIL;
     }
 
-    return false;
+    err = esp_partition_erase_range(s_update, offset, erase);
+    if (ESP_OK == err)
+    {
+        err = esp_partition_write(s_update, offset, data, size);
+    }
+    return err;
 }
 
-static size_t esp_ota_firm_do_parse_msg(esp_ota_firm_t *ota_firm, const char *in_buf, size_t in_len)
+/**
+ * Download of this image can be continued later.
+ */
+static inline bool ota_resumable(void)
 {
-    size_t tmp;
-    size_t parsed_bytes = in_len;
-
-    switch (ota_firm->state) {
-        case ESP_OTA_INIT:
-            if (_esp_ota_firm_parse_http(ota_firm, in_buf, in_len, &tmp)) {
-                ota_firm->state = ESP_OTA_PREPARE;
-                printf("Http parse %d bytes\n", tmp);
-                parsed_bytes = tmp;
-            }
-            break;
-        case ESP_OTA_PREPARE:
-            ota_firm->read_bytes += in_len;
-
-            if (ota_firm->read_bytes >= ota_firm->ota_offset) {
-                ota_firm->buf = &in_buf[in_len - (ota_firm->read_bytes - ota_firm->ota_offset)];
-                ota_firm->bytes = ota_firm->read_bytes - ota_firm->ota_offset;
-                ota_firm->write_bytes += ota_firm->read_bytes - ota_firm->ota_offset;
-                ota_firm->state = ESP_OTA_START;
-                printf("Receive %d bytes and start to update\n", ota_firm->read_bytes);
-                //printf("Write %d total %d", ota_firm->bytes, ota_firm->write_bytes);
-            }
-
-            break;
-        case ESP_OTA_START:
-            if (ota_firm->write_bytes + in_len >= ota_firm->ota_size) {
-                ota_firm->bytes = ota_firm->ota_size - ota_firm->write_bytes;
-                ota_firm->state = ESP_OTA_RECVED;
-            } else
-                ota_firm->bytes = in_len;
+    return s_ota_firm.image_id && s_ota_firm.single_image && !s_ota_firm.encoding;
+}
 
-            ota_firm->buf = in_buf;
+/**
+ * Save how much of image is in flash.
+ */
+static void ota_checkpoint(void)
+{
+    s_progress.image_id = s_ota_firm.image_id;
+    s_progress.address = s_update->address;
+    s_progress.written = s_written;
+    s_progress.crc = s_crc;
+    storage_ota_progress_set(&s_progress);
+}
 
-            ota_firm->write_bytes += ota_firm->bytes;
+/**
+ * Write data to flash and account time spent on it.
+ */
+static esp_err_t ota_flash(const void * data, size_t size)
+{
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = partition_write(s_written, data, size);
 
-            //printf("Write %d total %d\n", ota_firm->bytes, ota_firm->write_bytes);
+    s_flash_us += (uint32_t) (esp_timer_get_time() - start);
+    ++s_flash_writes;
 
-            break;
-        case ESP_OTA_RECVED:
-            parsed_bytes = 0;
-            ota_firm->state = ESP_OTA_FINISH;
-            break;
-        default:
-            parsed_bytes = 0;
-            ESP_LOGD(TAG, "State is %d", ota_firm->state);
-            break;
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error: flash write at %d failed! err=0x%x", s_written, err);
+        s_write_err = err;
     }
+    else
+    {
+        s_crc = crc32_update(s_crc, data, size);
+        s_written += size;
 
-    return parsed_bytes;
+        if (ota_resumable() && (0 == s_written % (OTA_CHECKPOINT_SECTORS * OTA_SECTOR_SIZE)))
+        {
+            ota_checkpoint();
+        }
+    }
+    return err;
 }
 
-static void esp_ota_firm_parse_msg(esp_ota_firm_t *ota_firm, const char *in_buf, size_t in_len)
+/**
+ * Staged sector (or end of image) goes to flash.
+ */
+static int sector_flash(void * ctx, const void * data, size_t size)
 {
-    size_t parse_bytes = 0;
+    return ESP_OK != ota_flash(data, size);
+}
 
-    ESP_LOGD(TAG, "Input %d bytes", in_len);
+/**
+ * Read part of running image for delta copy operation.
+ */
+static int sector_read(void * ctx, uint32_t offset, void * data, size_t size)
+{
+    return ESP_OK != esp_partition_read(s_running, offset, data, size);
+}
 
-    do {
-        size_t bytes = esp_ota_firm_do_parse_msg(ota_firm, in_buf + parse_bytes, in_len - parse_bytes);
-        ESP_LOGD(TAG, "Parse %d bytes", bytes);
-        if (bytes)
-            parse_bytes += bytes;
-    } while (parse_bytes != in_len);
+static int decoded_out(void * ctx, const uint8_t * data, size_t size)
+{
+    return ota_sector_write(&s_sector, data, size);
 }
 
-static inline int esp_ota_firm_is_finished(esp_ota_firm_t *ota_firm)
+/**
+ * Copy part of running image (delta operation) to staging buffer,
+ * reading flash straight into it.
+ */
+static int decoded_copy(void * ctx, uint32_t offset, uint32_t size)
 {
-    return (ota_firm->state == ESP_OTA_FINISH || ota_firm->state == ESP_OTA_RECVED);
+    if ((NULL == s_running) || (offset > s_running->size) || (size > s_running->size - offset))
+    {
+        ESP_LOGE(TAG, "delta copy %u+%u out of running image", offset, size);
+        return 1;
+    }
+    return ota_sector_copy(&s_sector, offset, size);
 }
 
-static inline int esp_ota_firm_can_write(esp_ota_firm_t *ota_firm)
+static int decompressed_out(void * ctx, const uint8_t * data, size_t size)
 {
-    return (ota_firm->state == ESP_OTA_START || ota_firm->state == ESP_OTA_RECVED);
+    if (s_ota_firm.encoding & OTA_ENC_DELTA)
+    {
+        return delta_decode(&s_decoder->delta, data, size, decoded_out, decoded_copy, ctx);
+    }
+    return decoded_out(ctx, data, size);
 }
 
-static inline const char* esp_ota_firm_get_write_buf(esp_ota_firm_t *ota_firm)
+/**
+ * Pass part of response body (image, maybe encoded) to flash.
+ */
+static esp_err_t ota_body(const char * data, size_t size)
 {
-    return ota_firm->buf;
+    int r;
+
+    if (0 == s_ota_firm.encoding)
+    {
+        return ota_sector_write(&s_sector, data, size) ? ESP_FAIL : ESP_OK;
+    }
+
+    if (NULL == s_decoder)
+    {
+        s_decoder = iobuf_lease(IOBUF_OTA_DECODER, sizeof(*s_decoder));
+        if (NULL == s_decoder)
+        {
+            ESP_LOGE(TAG, "No memory for decoder");
+            return ESP_FAIL;
+        }
+        lzss_init(&s_decoder->lzss);
+        delta_init(&s_decoder->delta);
+    }
+
+    if (s_ota_firm.encoding & OTA_ENC_LZSS)
+    {
+        r = lzss_decode(&s_decoder->lzss, (const uint8_t *) data, size, decompressed_out, NULL);
+    }
+    else
+    {
+        r = delta_decode(&s_decoder->delta, (const uint8_t *) data, size, decoded_out, decoded_copy, NULL);
+    }
+
+    if (OTA_DECODE_OK != r)
+    {
+        ESP_LOGE(TAG, "Image decoding failed %d", r);
+        s_write_err = ESP_FAIL;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
 }
 
-static inline size_t esp_ota_firm_get_write_bytes(esp_ota_firm_t *ota_firm)
+/**
+ * Header is parsed, decide where image data starts.
+ */
+static esp_err_t ota_body_begin(void)
 {
-    return ota_firm->bytes;
+    s_body_started = true;
+
+    if (!s_ota_firm.has_range)
+    {
+        s_written = 0;
+        s_crc = 0;
+        return ESP_OK;
+    }
+
+    if (!ota_resumable() || (s_ota_firm.image_id != s_progress.image_id)
+            || (s_ota_firm.range_start != s_progress.written))
+    {
+        ESP_LOGE(TAG, "Can not resume image %u at %u", s_ota_firm.image_id, s_ota_firm.range_start);
+        storage_ota_progress_set(NULL);
+        return ESP_FAIL;
+    }
+
+    DBG_PRINTF("Resuming image %u at %u\n", s_progress.image_id, s_progress.written);
+    s_written = s_progress.written;
+    s_crc = s_progress.crc;
+    return ESP_OK;
 }
 
-static void esp_ota_firm_init(esp_ota_firm_t *ota_firm, const esp_partition_t *update_partition)
+/**
+ * Read whole image back from flash and check it.
+ */
+static esp_err_t ota_verify(void)
 {
-    memset(ota_firm, 0, sizeof(esp_ota_firm_t));
-    ota_firm->state = ESP_OTA_INIT;
-    ota_firm->ota_num = get_ota_partition_count();
-    ota_firm->update_ota_num = update_partition->subtype - ESP_PARTITION_SUBTYPE_APP_OTA_0;
+    uint32_t crc = 0;
 
-    ESP_LOGI(TAG, "Totoal OTA number %d update to %d part", ota_firm->ota_num, ota_firm->update_ota_num);
+    for (size_t offset = 0; offset < s_written; offset += OTA_SECTOR_SIZE)
+    {
+        size_t n = s_written - offset;
+
+        if (n > OTA_SECTOR_SIZE)
+        {
+            n = OTA_SECTOR_SIZE;
+        }
+        if (ESP_OK != esp_partition_read(s_update, offset, s_sector.buffer, n))
+        {
+            return ESP_FAIL;
+        }
+        crc = crc32_update(crc, (const uint8_t *) s_sector.buffer, n);
+    }
 
+    if ((crc != s_crc) || (s_ota_firm.has_crc && (crc != s_ota_firm.image_crc)))
+    {
+        ESP_LOGE(TAG, "Image CRC %08X, received %08X, expected %08X", crc, s_crc, s_ota_firm.image_crc);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
 }
 
 static int ota_response_handler(const char * data, int length)
 {
+    int64_t now = esp_timer_get_time();
+
+    if (now - s_last_data_us > OTA_STALL_MS * 1000)
+    {
+        s_stall_us += (uint32_t) (now - s_last_data_us);
+    }
+
     if (length > 0)
     {
         esp_ota_firm_parse_msg(&s_ota_firm, data, length);
 
-        if (esp_ota_firm_can_write(&s_ota_firm))
+        if (s_ota_firm.failed)
+        {
+            return 1;
+        }
+
+        if (!s_body_started && (ESP_OTA_INIT != s_ota_firm.state) && (ESP_OK != ota_body_begin()))
         {
-            esp_err_t err;
-            int write_len = esp_ota_firm_get_write_bytes(&s_ota_firm);
-            memset(ota_write_buf, 0, sizeof(ota_write_buf));
-            memcpy(ota_write_buf, esp_ota_firm_get_write_buf(&s_ota_firm), write_len);
+            s_ota_firm.failed = true;
+            return 1;
+        }
 
-            err = esp_ota_write(s_update_handle, (const void *)ota_write_buf, write_len);
-            if (err != ESP_OK)
+        if (esp_ota_firm_can_write(&s_ota_firm))
+        {
+            if (ESP_OK != ota_body(esp_ota_firm_get_write_buf(&s_ota_firm),
+                    esp_ota_firm_get_write_bytes(&s_ota_firm)))
             {
-                ESP_LOGE(TAG, "Error: esp_ota_write failed! err=0x%x", err);
                 return 1;
             }
-            else
-            {
-                s_written += write_len;
-            }
         }
     }
     else if (length < 0)
@@ -230,11 +378,95 @@ static int ota_response_handler(const char * data, int length)
 
     if (esp_ota_firm_is_finished(&s_ota_firm))
     {
+        ota_sector_flush(&s_sector);
         return 1;
     }
 
+    /* waiting for next data starts after processing */
+    s_last_data_us = esp_timer_get_time();
+    return 0;
+
+}
+
+/**
+ * Prepare for new download.
+ * @return 0 on success
+ */
+static int ota_stage_begin(void)
+{
+    char * buffer;
+
+    s_written = 0;
+    s_crc = 0;
+    s_body_started = false;
+    s_write_err = ESP_OK;
+    s_flash_us = 0;
+    s_flash_writes = 0;
+    s_stall_us = 0;
+    s_last_data_us = esp_timer_get_time();
+
+    if (iobuf_open(OTA_IOBUF_SIZE))
+    {
+        return -1;
+    }
+    buffer = iobuf_lease(IOBUF_OTA_SECTOR, OTA_SECTOR_SIZE);
+    if (NULL == buffer)
+    {
+        iobuf_close();
+        return -1;
+    }
+    ota_sector_init(&s_sector, buffer, sector_flash, sector_read, NULL);
     return 0;
+}
+
+static void ota_stage_end(void)
+{
+    iobuf_release(IOBUF_OTA_SECTOR, s_sector.buffer);
+    s_sector.buffer = NULL;
+    if (NULL != s_decoder)
+    {
+        iobuf_release(IOBUF_OTA_DECODER, s_decoder);
+        s_decoder = NULL;
+    }
+    iobuf_close();
+}
+
+void ota_report(Request_t * request)
+{
+    OtaStats_t stats;
+    Request_t start = *request;
+    int r = 0;
+
+    if (0 == storage_ota_stats_get(&stats))
+    {
+        r |= request_seti(request, "ota_res", stats.result);
+        r |= request_setu(request, "ota_rx", stats.received);
+        r |= request_setu(request, "ota_wr", stats.written);
+        r |= request_setu(request, "ota_ms", stats.time_ms);
+        r |= request_setu(request, "ota_fl", stats.flash_ms);
+        r |= request_setu(request, "ota_st", stats.stall_ms);
+        /* download rate [B/s] */
+        r |= request_setu(request, "ota_bps", stats.time_ms ?
+                (uint32_t) ((uint64_t) stats.received * 1000 / stats.time_ms) : 0);
+        if (r)
+        {
+            /* does not fit - leave request as it was, report with next one */
+            *request = start;
+        }
+        else
+        {
+            s_report_pending = true;
+        }
+    }
+}
 
+void ota_report_done(void)
+{
+    if (s_report_pending)
+    {
+        storage_ota_stats_set(NULL);
+        s_report_pending = false;
+    }
 }
 
 int do_ota_upgrade(const char * endpoint)
@@ -243,6 +475,8 @@ int do_ota_upgrade(const char * endpoint)
     int r;
     Request_t req;
     const char * reqs;
+    int64_t start_us;
+    OtaStats_t stats;
     const esp_partition_t *configured = esp_ota_get_boot_partition();
     const esp_partition_t *partition = esp_ota_get_running_partition();
 
@@ -254,67 +488,120 @@ int do_ota_upgrade(const char * endpoint)
         return -1;
     }
 
-    printf("Currently running from partition @ %08X\n", partition->address);
+    DBG_PRINTF("Currently running from partition @ %08X\n", partition->address);
+    s_running = partition;
 
     partition = esp_ota_get_next_update_partition(NULL);
     assert(partition != NULL);
-    printf("New firmware goes to partition subtype %d at offset %08X\n",
+    DBG_PRINTF("New firmware goes to partition subtype %d at offset %08X\n",
             partition->subtype, partition->address);
 
-    s_written = 0;
+    s_update = partition;
+    if ((0 != storage_ota_progress_get(&s_progress)) || (s_progress.address != partition->address))
+    {
+        memset(&s_progress, 0, sizeof(s_progress));
+    }
+
+    if (ota_stage_begin())
+    {
+        return -1;
+    }
 
     r = client_open();
     if (r)
     {
         ESP_LOGE(TAG, "Failed to open connection %d\n", r);
+        ota_stage_end();
         return r;
     }
 
+    /* download and flash writes run at high clock */
+    power_boost_begin();
+    energy_phase_begin(ENERGY_PH_OTA);
+    start_us = esp_timer_get_time();
+
+    /* server that knows the slot sends only that image,
+     * otherwise we get all of them */
     request_new(&req, endpoint);
-    reqs = request_make(&req);
+    request_seti(&req, "slot", partition->subtype - ESP_PARTITION_SUBTYPE_APP_OTA_0);
+    request_sets(&req, "enc", "lzss,delta");
+    if (s_progress.written)
+    {
+        /* continue interrupted download of the same image */
+        request_setu(&req, "image", s_progress.image_id);
+        reqs = request_make_range(&req, s_progress.written);
+    }
+    else
+    {
+        reqs = request_make(&req);
+    }
 
-    r = client_request(reqs, strlen(reqs));
+    r = (NULL != reqs) ? client_request(reqs, strlen(reqs)) : -1;
 
     if (r)
     {
         ESP_LOGE(TAG, "Failed to create request: %d\n", r);
         client_close();
+        ota_stage_end();
+        energy_phase_end(ENERGY_PH_OTA);
+        power_boost_end();
         return r;
     }
 
-    err = esp_ota_begin(partition, OTA_SIZE_UNKNOWN, &s_update_handle);
+    ota_parse_init(&s_ota_firm, partition);
+    s_last_data_us = esp_timer_get_time();
+    client_response_hdl(ota_response_handler);
+    client_close();
 
-    if (err != ESP_OK)
+    err = s_write_err;
+    if ((ESP_OK == err) && esp_ota_firm_is_finished(&s_ota_firm))
     {
-        ESP_LOGE(TAG, "esp_ota_begin failed, error=%d", err);
-        client_close();
-        return -2;
+        err = ota_verify();
+        storage_ota_progress_set(NULL);
     }
+    else if (ota_resumable() && s_written)
+    {
+        /* whole sectors written so far */
+        ota_checkpoint();
+        DBG_PRINTF("Download interrupted at %d bytes\n", s_written);
+    }
+    ota_stage_end();
 
-    esp_ota_firm_init(&s_ota_firm, partition);
-    client_response_hdl(ota_response_handler);
-    client_close();
+    stats.received = s_ota_firm.write_bytes;
+    stats.written = s_written;
+    stats.time_ms = (uint32_t) ((esp_timer_get_time() - start_us) / 1000);
+    stats.flash_ms = s_flash_us / 1000;
+    stats.stall_ms = s_stall_us / 1000;
 
-    printf("Written %d bytes\n", s_written);
+    DBG_PRINTF("Written %d bytes (received %u, encoding %d) in %u ms @ %u MHz, flash %u ms in %u writes,"
+            " stalled %u ms\n", s_written, stats.received, s_ota_firm.encoding, stats.time_ms,
+            power_cpu_mhz(), stats.flash_ms, s_flash_writes, stats.stall_ms);
+    energy_phase_end(ENERGY_PH_OTA);
+    power_boost_end();
 
-    if (esp_ota_end(s_update_handle) != ESP_OK)
+    if ((ESP_OK == err) && !esp_ota_firm_is_finished(&s_ota_firm))
     {
-        ESP_LOGE(TAG, "esp_ota_end failed!");
+        /* connection broken */
+        err = ESP_FAIL;
     }
 
-    if (esp_ota_firm_is_finished(&s_ota_firm))
+    if (ESP_OK == err)
     {
         err = esp_ota_set_boot_partition(partition);
         if (err != ESP_OK)
         {
             ESP_LOGE(TAG, "esp_ota_set_boot_partition failed! err=0x%x", err);
         }
-        else
-        {
-            ESP_LOGI(TAG, "Prepare to restart system!");
-            esp_restart();
-        }
+    }
 
+    /* reported after restart or with next upload */
+    stats.result = (int32_t) err;
+    storage_ota_stats_set(&stats);
+
+    if (ESP_OK == err)
+    {
+        ESP_LOGI(TAG, "Prepare to restart system!");
+        esp_restart();
     }
 
     return (int) err;
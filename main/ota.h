@@ -8,7 +8,23 @@
 #ifndef MAIN_OTA_H_
 #define MAIN_OTA_H_
 
+#include "client.h"
+
 int do_ota_upgrade(const char * endpoint);
 
+/**
+ * Longest text added by ota_report [B].
+ */
+#define OTA_REPORT_MAX          129
+/**
+ * Add statistics of last firmware download (if not reported yet)
+ * to request. Nothing is added when they do not fit.
+ */
+void ota_report(Request_t * request);
+/**
+ * Statistics were delivered to server.
+ */
+void ota_report_done(void);
+
 
 #endif /* MAIN_OTA_H_ */
@@ -0,0 +1,190 @@
+/**
+ * Streaming decoders of encoded firmware images.
+ * ota_decode.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include <string.h>
+
+#include "ota_decode.h"
+
+#define LZSS_WINDOW_MASK    ((1 << LZSS_WINDOW_BITS) - 1)
+/**
+ * Decompressed bytes passed to consumer at once.
+ */
+#define LZSS_OUT_CHUNK      64
+
+enum {
+    LZSS_TAG = 0,           /**< 1 - literal follows, 0 - back-reference. */
+    LZSS_LITERAL,
+    LZSS_INDEX,
+    LZSS_COUNT,
+};
+
+enum {
+    DELTA_OP = 0,
+    DELTA_ARGS,
+    DELTA_LITERAL,
+};
+
+static const uint8_t s_lzss_bits[] = {
+    [LZSS_TAG] = 1,
+    [LZSS_LITERAL] = 8,
+    [LZSS_INDEX] = LZSS_WINDOW_BITS,
+    [LZSS_COUNT] = LZSS_LOOKAHEAD_BITS,
+};
+
+static inline uint32_t get_le32(const uint8_t * p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+void lzss_init(LzssDecoder_t * dec)
+{
+    /* back-references before start of data read zeros,
+     * same as in encoder */
+    memset(dec, 0, sizeof(*dec));
+    dec->state = LZSS_TAG;
+}
+
+int lzss_decode(LzssDecoder_t * dec, const uint8_t * in, size_t size, ota_decode_out out, void * ctx)
+{
+    uint8_t buf[LZSS_OUT_CHUNK];
+    int n = 0;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        dec->bits = (dec->bits << 8) | in[i];
+        dec->bit_count += 8;
+
+        while (dec->bit_count >= s_lzss_bits[dec->state])
+        {
+            uint8_t need = s_lzss_bits[dec->state];
+            uint32_t v = (dec->bits >> (dec->bit_count - need)) & ((1UL << need) - 1);
+            uint32_t count = 0;
+
+            dec->bit_count -= need;
+
+            switch (dec->state)
+            {
+            case LZSS_TAG:
+                dec->state = v ? LZSS_LITERAL : LZSS_INDEX;
+                break;
+            case LZSS_LITERAL:
+                dec->window[dec->head++ & LZSS_WINDOW_MASK] = (uint8_t) v;
+                buf[n++] = (uint8_t) v;
+                dec->state = LZSS_TAG;
+                break;
+            case LZSS_INDEX:
+                dec->index = (uint16_t) (v + 1);
+                dec->state = LZSS_COUNT;
+                break;
+            case LZSS_COUNT:
+                count = v + 1;
+                dec->state = LZSS_TAG;
+                break;
+            default:
+                return OTA_DECODE_E_FORMAT;
+            }
+
+            while (count || (n == sizeof(buf)))
+            {
+                if (n == sizeof(buf))
+                {
+                    if (out(ctx, buf, n))
+                    {
+                        return OTA_DECODE_E_OUTPUT;
+                    }
+                    n = 0;
+                }
+                if (count)
+                {
+                    uint8_t c = dec->window[(dec->head - dec->index) & LZSS_WINDOW_MASK];
+
+                    dec->window[dec->head++ & LZSS_WINDOW_MASK] = c;
+                    buf[n++] = c;
+                    --count;
+                }
+            }
+        }
+    }
+
+    if (n && out(ctx, buf, n))
+    {
+        return OTA_DECODE_E_OUTPUT;
+    }
+    return OTA_DECODE_OK;
+}
+
+void delta_init(DeltaDecoder_t * dec)
+{
+    memset(dec, 0, sizeof(*dec));
+    dec->state = DELTA_OP;
+}
+
+int delta_decode(DeltaDecoder_t * dec, const uint8_t * in, size_t size,
+        ota_decode_out out, ota_decode_copy copy, void * ctx)
+{
+    size_t i = 0;
+
+    while (i < size)
+    {
+        switch (dec->state)
+        {
+        case DELTA_OP:
+            dec->op = in[i++];
+            if ((DELTA_OP_COPY != dec->op) && (DELTA_OP_LITERAL != dec->op))
+            {
+                return OTA_DECODE_E_FORMAT;
+            }
+            dec->arg_len = 0;
+            dec->state = DELTA_ARGS;
+            break;
+
+        case DELTA_ARGS:
+            dec->arg[dec->arg_len++] = in[i++];
+            if ((DELTA_OP_COPY == dec->op) && (8 == dec->arg_len))
+            {
+                if (copy(ctx, get_le32(&dec->arg[0]), get_le32(&dec->arg[4])))
+                {
+                    return OTA_DECODE_E_OUTPUT;
+                }
+                dec->state = DELTA_OP;
+            }
+            else if ((DELTA_OP_LITERAL == dec->op) && (4 == dec->arg_len))
+            {
+                dec->remaining = get_le32(&dec->arg[0]);
+                dec->state = dec->remaining ? DELTA_LITERAL : DELTA_OP;
+            }
+            break;
+
+        case DELTA_LITERAL:
+        {
+            /* literal data goes straight from input */
+            size_t n = size - i;
+
+            if (n > dec->remaining)
+            {
+                n = dec->remaining;
+            }
+            if (out(ctx, &in[i], n))
+            {
+                return OTA_DECODE_E_OUTPUT;
+            }
+            i += n;
+            dec->remaining -= n;
+            if (0 == dec->remaining)
+            {
+                dec->state = DELTA_OP;
+            }
+            break;
+        }
+
+        default:
+            return OTA_DECODE_E_FORMAT;
+        }
+    }
+    return OTA_DECODE_OK;
+}
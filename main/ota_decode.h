@@ -0,0 +1,85 @@
+/**
+ * Streaming decoders of encoded firmware images:
+ * LZSS (heatshrink format) and binary delta against running image.
+ * Both take input in chunks of any size and keep bounded state.
+ *
+ * ota_decode.h
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#ifndef MAIN_OTA_DECODE_H_
+#define MAIN_OTA_DECODE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define OTA_DECODE_OK       0   /**< Input consumed. */
+#define OTA_DECODE_E_FORMAT 1   /**< Malformed input. */
+#define OTA_DECODE_E_OUTPUT 2   /**< Output callback failed. */
+
+/**
+ * LZSS window size (log2), image must be compressed with
+ * "heatshrink -e -w 10 -l 4".
+ */
+#define LZSS_WINDOW_BITS    10
+/**
+ * LZSS back-reference length bits.
+ */
+#define LZSS_LOOKAHEAD_BITS 4
+
+/**
+ * Delta operations: 'C' <offset u32> <length u32> copies from running
+ * image, 'L' <length u32> <bytes> inserts bytes. Numbers are little endian.
+ */
+#define DELTA_OP_COPY       'C'
+#define DELTA_OP_LITERAL    'L'
+
+/**
+ * Consumer of decoded bytes.
+ * @return 0 on success
+ */
+typedef int (*ota_decode_out)(void * ctx, const uint8_t * data, size_t size);
+/**
+ * Consumer of delta copy operation - bytes of running image.
+ * @return 0 on success
+ */
+typedef int (*ota_decode_copy)(void * ctx, uint32_t offset, uint32_t size);
+
+typedef struct {
+    uint8_t window[1 << LZSS_WINDOW_BITS];
+    uint16_t head;          /**< Next write position in window. */
+    uint32_t bits;          /**< Input bits not used yet (lowest ones). */
+    uint8_t bit_count;
+    uint8_t state;
+    uint16_t index;         /**< Back-reference distance. */
+} LzssDecoder_t;
+
+typedef struct {
+    uint8_t state;
+    uint8_t op;
+    uint8_t arg_len;        /**< Bytes of arguments collected. */
+    uint8_t arg[8];
+    uint32_t remaining;     /**< Literal bytes still to come. */
+} DeltaDecoder_t;
+
+void lzss_init(LzssDecoder_t * dec);
+/**
+ * Decompress chunk of input.
+ * @param out receives decompressed data
+ * @return OTA_DECODE_OK or error code
+ */
+int lzss_decode(LzssDecoder_t * dec, const uint8_t * in, size_t size, ota_decode_out out, void * ctx);
+
+void delta_init(DeltaDecoder_t * dec);
+/**
+ * Apply chunk of delta operations.
+ * @param out receives literal data
+ * @param copy receives copy operations
+ * @return OTA_DECODE_OK or error code
+ */
+int delta_decode(DeltaDecoder_t * dec, const uint8_t * in, size_t size,
+        ota_decode_out out, ota_decode_copy copy, void * ctx);
+
+#endif /* MAIN_OTA_DECODE_H_ */
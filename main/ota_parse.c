@@ -0,0 +1,230 @@
+/**
+ * Parser of OTA download response.
+ * ota_parse.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "ota_parse.h"
+#include "debug.h"
+
+/**
+ * Reason why response can not be used, on console.
+ */
+#define OTA_ERROR(fmt, ...) DBG_PRINTF("OTA: " fmt "\n", ##__VA_ARGS__)
+
+/**
+ * Check if line is header of given name.
+ * @return header value (spaces skipped) or NULL
+ */
+static const char * header_value(const char * line, const char * name)
+{
+    size_t len = strlen(name);
+
+    if (strncasecmp(line, name, len))
+    {
+        return NULL;
+    }
+    line += len;
+    while (' ' == *line)
+    {
+        ++line;
+    }
+    return line;
+}
+
+/**
+ * Use one complete line of response header.
+ * @return false if response can not be used
+ */
+static bool _esp_ota_firm_parse_line(esp_ota_firm_t *ota_firm, const char *line)
+{
+    const char *value;
+
+    if (ota_firm->status == 0) {
+        /* status line: HTTP/1.x 200 OK */
+        value = strchr(line, ' ');
+        ota_firm->status = value ? atoi(value) : -1;
+        if (ota_firm->status != 200 && ota_firm->status != 206) {
+            OTA_ERROR("HTTP status %d", ota_firm->status);
+            return false;
+        }
+    } else if ((value = header_value(line, OTA_LENGTH_HEADER)) != NULL) {
+        ota_firm->content_len = atoi(value);
+    } else if ((value = header_value(line, OTA_SLOT_HEADER)) != NULL) {
+        int slot = atoi(value);
+
+        if (slot != ota_firm->update_ota_num) {
+            OTA_ERROR("server sent image for slot %d, need %d", slot, ota_firm->update_ota_num);
+            return false;
+        }
+        ota_firm->single_image = true;
+    } else if ((value = header_value(line, OTA_ENCODING_HEADER)) != NULL) {
+        if (strstr(value, "lzss")) {
+            ota_firm->encoding |= OTA_ENC_LZSS;
+        }
+        if (strstr(value, "delta")) {
+            ota_firm->encoding |= OTA_ENC_DELTA;
+        }
+        if (!ota_firm->encoding) {
+            OTA_ERROR("unknown image encoding");
+            return false;
+        }
+    } else if ((value = header_value(line, OTA_IMAGE_HEADER)) != NULL) {
+        ota_firm->image_id = strtoul(value, NULL, 0);
+    } else if ((value = header_value(line, OTA_CRC_HEADER)) != NULL) {
+        ota_firm->image_crc = strtoul(value, NULL, 16);
+        ota_firm->has_crc = true;
+    } else if ((value = header_value(line, OTA_RANGE_HEADER)) != NULL) {
+        /* bytes <first>-<last>/<total> */
+        value = header_value(value, "bytes");
+        if (value == NULL) {
+            OTA_ERROR("unknown range unit");
+            return false;
+        }
+        ota_firm->range_start = strtoul(value, NULL, 10);
+        ota_firm->has_range = true;
+    }
+    return true;
+}
+
+/**
+ * Parse response header, which can come in any pieces.
+ * Only bytes of header are consumed.
+ * @return true when header is complete (parse_len - bytes of it in text)
+ */
+static bool _esp_ota_firm_parse_http(esp_ota_firm_t *ota_firm, const char *text, size_t total_len, size_t *parse_len)
+{
+    for (size_t i = 0; i < total_len; ++i) {
+        char c = text[i];
+
+        if (c != '\n') {
+            if (ota_firm->line_len < sizeof(ota_firm->line) - 1) {
+                ota_firm->line[ota_firm->line_len++] = c;
+            }
+            continue;
+        }
+
+        if (ota_firm->line_len && ota_firm->line[ota_firm->line_len - 1] == '\r') {
+            --ota_firm->line_len;
+        }
+        ota_firm->line[ota_firm->line_len] = 0;
+
+        if (ota_firm->line_len == 0 && ota_firm->status != 0) {
+            /* empty line - end of header */
+            if (ota_firm->content_len == 0) {
+                OTA_ERROR("did not parse Content-Length item");
+            }
+
+            if (ota_firm->encoding && !ota_firm->single_image) {
+                OTA_ERROR("encoded image must be single");
+                ota_firm->failed = true;
+                return false;
+            }
+
+            if (ota_firm->single_image) {
+                ota_firm->ota_size = ota_firm->content_len;
+                ota_firm->ota_offset = 0;
+            } else {
+                /* all images one after another, skip ones before ours */
+                ota_firm->ota_size = ota_firm->content_len / ota_firm->ota_num;
+                ota_firm->ota_offset = ota_firm->ota_size * ota_firm->update_ota_num;
+            }
+            DBG_PRINTF("parse Content-Length:%d, ota_size %d%s encoding %d\n", (int) ota_firm->content_len,
+                    (int) ota_firm->ota_size, ota_firm->single_image ? " (single image)" : "", ota_firm->encoding);
+
+            *parse_len = i + 1;
+
+            return true;
+        }
+
+        if (ota_firm->line_len && !_esp_ota_firm_parse_line(ota_firm, ota_firm->line)) {
+            ota_firm->failed = true;
+            return false;
+        }
+        ota_firm->line_len = 0;
+    }
+
+    return false;
+}
+
+static size_t esp_ota_firm_do_parse_msg(esp_ota_firm_t *ota_firm, const char *in_buf, size_t in_len)
+{
+    size_t tmp;
+    size_t parsed_bytes = in_len;
+
+    switch (ota_firm->state) {
+        case ESP_OTA_INIT:
+            if (_esp_ota_firm_parse_http(ota_firm, in_buf, in_len, &tmp)) {
+                ota_firm->state = ESP_OTA_PREPARE;
+                DBG_PRINTF("Http parse %d bytes\n", (int) tmp);
+                parsed_bytes = tmp;
+            }
+            break;
+        case ESP_OTA_PREPARE:
+            ota_firm->read_bytes += in_len;
+
+            if (ota_firm->read_bytes >= ota_firm->ota_offset) {
+                size_t image_bytes = ota_firm->read_bytes - ota_firm->ota_offset;
+
+                ota_firm->buf = &in_buf[in_len - image_bytes];
+                /* whole (rest of) image can come with header */
+                if (ota_firm->write_bytes + image_bytes >= ota_firm->ota_size) {
+                    ota_firm->bytes = ota_firm->ota_size - ota_firm->write_bytes;
+                    ota_firm->state = ESP_OTA_RECVED;
+                } else {
+                    ota_firm->bytes = image_bytes;
+                    ota_firm->state = ESP_OTA_START;
+                }
+                ota_firm->write_bytes += ota_firm->bytes;
+                DBG_PRINTF("Receive %d bytes and start to update\n", (int) ota_firm->read_bytes);
+            }
+
+            break;
+        case ESP_OTA_START:
+            if (ota_firm->write_bytes + in_len >= ota_firm->ota_size) {
+                ota_firm->bytes = ota_firm->ota_size - ota_firm->write_bytes;
+                ota_firm->state = ESP_OTA_RECVED;
+            } else
+                ota_firm->bytes = in_len;
+
+            ota_firm->buf = in_buf;
+
+            ota_firm->write_bytes += ota_firm->bytes;
+
+            break;
+        case ESP_OTA_RECVED:
+            parsed_bytes = 0;
+            ota_firm->state = ESP_OTA_FINISH;
+            break;
+        default:
+            parsed_bytes = 0;
+            break;
+    }
+
+    return parsed_bytes;
+}
+
+void esp_ota_firm_parse_msg(esp_ota_firm_t *ota_firm, const char *in_buf, size_t in_len)
+{
+    size_t parse_bytes = 0;
+
+    do {
+        size_t bytes = esp_ota_firm_do_parse_msg(ota_firm, in_buf + parse_bytes, in_len - parse_bytes);
+        if (bytes)
+            parse_bytes += bytes;
+    } while (parse_bytes != in_len);
+}
+
+void esp_ota_firm_init(esp_ota_firm_t *ota_firm, uint8_t ota_num, uint8_t update_ota_num)
+{
+    memset(ota_firm, 0, sizeof(esp_ota_firm_t));
+    ota_firm->state = ESP_OTA_INIT;
+    ota_firm->ota_num = ota_num;
+    ota_firm->update_ota_num = update_ota_num;
+}
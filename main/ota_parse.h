@@ -0,0 +1,124 @@
+/**
+ * Parser of OTA download response: header (in any pieces) and
+ * position of image for our slot in body. No SDK dependencies,
+ * builds also on host (test/ota_parse).
+ *
+ * ota_parse.h
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#ifndef MAIN_OTA_PARSE_H_
+#define MAIN_OTA_PARSE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum esp_ota_firm_state {
+    ESP_OTA_INIT = 0,
+    ESP_OTA_PREPARE,
+    ESP_OTA_START,
+    ESP_OTA_RECVED,
+    ESP_OTA_FINISH,
+} esp_ota_firm_state_t;
+
+/**
+ * Longest header line kept for parsing, rest of longer line is ignored.
+ */
+#define OTA_LINE_MAX        96
+
+/**
+ * Response header of server that sends image of requested slot only,
+ * value is the slot.
+ */
+#define OTA_SLOT_HEADER     "X-Ota-Slot:"
+/**
+ * Response header of server that sends encoded image, value lists
+ * encodings: "lzss" (compressed), "delta" (against running image)
+ * or both (compressed delta).
+ */
+#define OTA_ENCODING_HEADER "X-Ota-Encoding:"
+
+#define OTA_ENC_LZSS        0x01
+#define OTA_ENC_DELTA       0x02
+/**
+ * Response header with identifier of image (number), needed for
+ * resuming interrupted download.
+ */
+#define OTA_IMAGE_HEADER    "X-Ota-Image:"
+/**
+ * Response header with CRC32 of whole image (hex), optional.
+ */
+#define OTA_CRC_HEADER      "X-Ota-Crc32:"
+#define OTA_RANGE_HEADER    "Content-Range:"
+#define OTA_LENGTH_HEADER   "Content-Length:"
+
+typedef struct esp_ota_firm {
+    uint8_t             ota_num;
+    uint8_t             update_ota_num;
+
+    esp_ota_firm_state_t    state;
+
+    size_t              content_len;
+
+    size_t              read_bytes;
+    size_t              write_bytes;
+
+    size_t              ota_size;
+    size_t              ota_offset;
+
+    bool                single_image;   /**< Server sent only image for our slot. */
+    uint8_t             encoding;       /**< OTA_ENC_* flags. */
+    bool                failed;         /**< Response can not be used. */
+
+    uint32_t            image_id;       /**< Identifier of image, 0 - not given. */
+    uint32_t            image_crc;      /**< CRC32 of whole image. */
+    bool                has_crc;
+    bool                has_range;      /**< Body is rest of image, from range_start. */
+    size_t              range_start;
+
+    int                 status;         /**< HTTP status, 0 - status line not parsed yet. */
+    char                line[OTA_LINE_MAX];
+    size_t              line_len;
+
+    const char          *buf;
+    size_t              bytes;
+} esp_ota_firm_t;
+
+/**
+ * Prepare for new response.
+ * @param ota_num count of OTA slots (images in dual response)
+ * @param update_ota_num slot being written
+ */
+void esp_ota_firm_init(esp_ota_firm_t *ota_firm, uint8_t ota_num, uint8_t update_ota_num);
+/**
+ * Parse next piece of response. When it carries image data,
+ * esp_ota_firm_can_write() is true and the data is at
+ * esp_ota_firm_get_write_buf() (inside in_buf). Check failed
+ * flag after each call.
+ */
+void esp_ota_firm_parse_msg(esp_ota_firm_t *ota_firm, const char *in_buf, size_t in_len);
+
+static inline int esp_ota_firm_is_finished(esp_ota_firm_t *ota_firm)
+{
+    return (ota_firm->state == ESP_OTA_FINISH || ota_firm->state == ESP_OTA_RECVED);
+}
+
+static inline int esp_ota_firm_can_write(esp_ota_firm_t *ota_firm)
+{
+    return (ota_firm->state == ESP_OTA_START || ota_firm->state == ESP_OTA_RECVED);
+}
+
+static inline const char* esp_ota_firm_get_write_buf(esp_ota_firm_t *ota_firm)
+{
+    return ota_firm->buf;
+}
+
+static inline size_t esp_ota_firm_get_write_bytes(esp_ota_firm_t *ota_firm)
+{
+    return ota_firm->bytes;
+}
+
+#endif /* MAIN_OTA_PARSE_H_ */
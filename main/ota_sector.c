@@ -0,0 +1,97 @@
+/**
+ * Staging of OTA image data into whole flash sectors.
+ * ota_sector.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include <string.h>
+
+#include "ota_sector.h"
+
+void ota_sector_init(OtaSector_t * sector, char * buffer, ota_sector_flash flash, ota_sector_read read, void * ctx)
+{
+    sector->buffer = buffer;
+    sector->fill = 0;
+    sector->flash = flash;
+    sector->read = read;
+    sector->ctx = ctx;
+}
+
+/**
+ * Flash buffer when it is full.
+ * @return 0 on success
+ */
+static int sector_full(OtaSector_t * sector)
+{
+    if (OTA_SECTOR_SIZE != sector->fill)
+    {
+        return 0;
+    }
+    sector->fill = 0;
+    return sector->flash(sector->ctx, sector->buffer, OTA_SECTOR_SIZE);
+}
+
+int ota_sector_write(OtaSector_t * sector, const void * data, size_t size)
+{
+    const char * bytes = data;
+
+    while (size)
+    {
+        size_t n = OTA_SECTOR_SIZE - sector->fill;
+
+        if (n > size)
+        {
+            n = size;
+        }
+        memcpy(&sector->buffer[sector->fill], bytes, n);
+        sector->fill += n;
+        bytes += n;
+        size -= n;
+
+        if (sector_full(sector))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int ota_sector_copy(OtaSector_t * sector, uint32_t offset, uint32_t size)
+{
+    while (size)
+    {
+        size_t n = OTA_SECTOR_SIZE - sector->fill;
+
+        if (n > size)
+        {
+            n = size;
+        }
+        if (sector->read(sector->ctx, offset, &sector->buffer[sector->fill], n))
+        {
+            return 1;
+        }
+        sector->fill += n;
+        offset += n;
+        size -= n;
+
+        if (sector_full(sector))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int ota_sector_flush(OtaSector_t * sector)
+{
+    size_t fill = sector->fill;
+
+    if (0 == fill)
+    {
+        return 0;
+    }
+    sector->fill = 0;
+    return sector->flash(sector->ctx, sector->buffer, fill);
+}
@@ -0,0 +1,59 @@
+/**
+ * Staging of OTA image data into whole flash sectors. Every byte
+ * is copied once into sector buffer, flash gets only full sectors
+ * (and the rest at end of image). No SDK dependencies.
+ *
+ * ota_sector.h
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#ifndef MAIN_OTA_SECTOR_H_
+#define MAIN_OTA_SECTOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Flash sector size [B], checked against SDK in ota.c.
+ */
+#define OTA_SECTOR_SIZE     4096
+
+/**
+ * Write of staged data, next part of image.
+ * @return 0 on success
+ */
+typedef int (*ota_sector_flash)(void * ctx, const void * data, size_t size);
+/**
+ * Read of running image (for delta copy), straight into sector buffer.
+ * @return 0 on success
+ */
+typedef int (*ota_sector_read)(void * ctx, uint32_t offset, void * data, size_t size);
+
+typedef struct {
+    char * buffer;          /**< OTA_SECTOR_SIZE bytes. */
+    size_t fill;
+    ota_sector_flash flash;
+    ota_sector_read read;
+    void * ctx;
+} OtaSector_t;
+
+void ota_sector_init(OtaSector_t * sector, char * buffer, ota_sector_flash flash, ota_sector_read read, void * ctx);
+/**
+ * Add image data, flash full sectors.
+ * @return 0 on success
+ */
+int ota_sector_write(OtaSector_t * sector, const void * data, size_t size);
+/**
+ * Add part of running image, flash full sectors.
+ * @return 0 on success
+ */
+int ota_sector_copy(OtaSector_t * sector, uint32_t offset, uint32_t size);
+/**
+ * Flash what is left in buffer (end of image).
+ * @return 0 on success
+ */
+int ota_sector_flush(OtaSector_t * sector);
+
+#endif /* MAIN_OTA_SECTOR_H_ */
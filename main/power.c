@@ -0,0 +1,119 @@
+/*
+ * CPU clock control.
+ * power.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include "power.h"
+#include "energy.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_system.h"
+#include "esp_clk.h"
+#include "esp_log.h"
+
+#include "driver/adc.h"
+
+/**
+ * Uncomment to always run at low clock (for comparing
+ * time and energy of boosted and non boosted phases).
+ */
+//#define POWER_BOOST_DISABLE
+
+static const char * TAG = "power";
+
+/**
+ * Guards clock changes and boost nesting (boost is used by
+ * several tasks). Held by sensor driver while it is counting CPU ticks.
+ */
+static SemaphoreHandle_t s_freq_lock = NULL;
+/**
+ * Nesting level of boost phases.
+ */
+static int s_boost_count = 0;
+
+/**
+ * Change clock, s_freq_lock must be held.
+ */
+static void set_freq_locked(esp_cpu_freq_t freq)
+{
+#ifndef POWER_BOOST_DISABLE
+    esp_err_t err;
+
+    energy_update();
+    err = esp_set_cpu_freq(freq);
+
+    if (ESP_OK != err)
+    {
+        ESP_LOGW(TAG, "Failed to set clock %d (err=%d)", (int) freq, err);
+    }
+#endif
+}
+
+void power_init(void)
+{
+    s_freq_lock = xSemaphoreCreateMutex();
+    s_boost_count = 0;
+    xSemaphoreTake(s_freq_lock, portMAX_DELAY);
+    set_freq_locked(ESP_CPU_FREQ_80M);
+    xSemaphoreGive(s_freq_lock);
+}
+
+void power_boost_begin(void)
+{
+    xSemaphoreTake(s_freq_lock, portMAX_DELAY);
+    if (0 == s_boost_count++)
+    {
+        set_freq_locked(ESP_CPU_FREQ_160M);
+    }
+    xSemaphoreGive(s_freq_lock);
+}
+
+void power_boost_end(void)
+{
+    xSemaphoreTake(s_freq_lock, portMAX_DELAY);
+    if ((s_boost_count > 0) && (0 == --s_boost_count))
+    {
+        set_freq_locked(ESP_CPU_FREQ_80M);
+    }
+    xSemaphoreGive(s_freq_lock);
+}
+
+void power_freq_hold(void)
+{
+    xSemaphoreTake(s_freq_lock, portMAX_DELAY);
+}
+
+void power_freq_release(void)
+{
+    xSemaphoreGive(s_freq_lock);
+}
+
+uint32_t power_cpu_mhz(void)
+{
+    return (uint32_t) (esp_clk_cpu_freq() / 1000000);
+}
+
+uint32_t power_supply_mv(void)
+{
+    adc_config_t adc_cfg = {
+            .mode = ADC_READ_VDD_MODE,
+            .clk_div = 8,
+    };
+    uint16_t mv = 0;
+
+    if (ESP_OK == adc_init(&adc_cfg))
+    {
+        if (ESP_OK != adc_read(&mv))
+        {
+            mv = 0;
+        }
+        adc_deinit();
+    }
+
+    return mv;
+}
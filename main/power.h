@@ -0,0 +1,51 @@
+/*
+ * CPU clock control.
+ * power.h
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#ifndef MAIN_POWER_H_
+#define MAIN_POWER_H_
+
+#include <stdint.h>
+
+/**
+ * Initialize module. CPU starts at low clock.
+ */
+void power_init(void);
+/**
+ * Switch CPU to high clock (160MHz) for CPU-heavy phase
+ * (request encoding, upload, OTA).
+ * Calls can be nested (also by different tasks), each must be paired
+ * with power_boost_end().
+ */
+void power_boost_begin(void);
+/**
+ * Leave high clock phase. When last nested phase ends,
+ * CPU goes back to low clock (80MHz).
+ */
+void power_boost_end(void);
+/**
+ * Prevent clock changes (e.g. during time critical sensor read).
+ * Blocks until pending clock change is finished.
+ */
+void power_freq_hold(void);
+/**
+ * Allow clock changes again.
+ */
+void power_freq_release(void);
+/**
+ * Return current CPU clock [MHz].
+ */
+uint32_t power_cpu_mhz(void);
+/**
+ * Measure supply voltage [mV].
+ * Requires VDD33 ADC mode (byte 107 of PHY init data set to 0xFF,
+ * CONFIG_ESP_PHY_INIT_DATA_VDD33_CONST=255 in sdkconfig).
+ * @return voltage or 0 if not available
+ */
+uint32_t power_supply_mv(void);
+
+#endif /* MAIN_POWER_H_ */
@@ -0,0 +1,88 @@
+/*
+ * Single producer, single consumer ring of measurement records.
+ * record_ring.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include "record_ring.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static MeasRecord_t s_ring[RECORD_RING_SIZE];
+/**
+ * Count of records pushed, written only by producer.
+ */
+static volatile uint32_t s_head = 0;
+/**
+ * Count of records popped, written only by consumer.
+ */
+static volatile uint32_t s_tail = 0;
+static TaskHandle_t s_consumer = NULL;
+
+void record_ring_init(void)
+{
+    s_head = 0;
+    s_tail = 0;
+    s_consumer = xTaskGetCurrentTaskHandle();
+}
+
+bool record_ring_push(const MeasRecord_t * record)
+{
+    uint32_t head = s_head;
+
+    if ((head - s_tail) >= RECORD_RING_SIZE)
+    {
+        return false;
+    }
+
+    s_ring[head & (RECORD_RING_SIZE - 1)] = *record;
+    /* record must be complete before it is published */
+    __sync_synchronize();
+    s_head = head + 1;
+
+    if (s_consumer)
+    {
+        xTaskNotifyGive(s_consumer);
+    }
+    return true;
+}
+
+bool record_ring_pop(MeasRecord_t * record, uint32_t timeout)
+{
+    uint32_t tail = s_tail;
+
+    if (tail == s_head)
+    {
+        /* notifications are counted, wait for next one */
+        ulTaskNotifyTake(pdTRUE, timeout);
+        if (tail == s_head)
+        {
+            return false;
+        }
+    }
+
+    /* record is read only after head that published it */
+    __sync_synchronize();
+    *record = s_ring[tail & (RECORD_RING_SIZE - 1)];
+    /* and before its slot is given back to producer */
+    __sync_synchronize();
+    s_tail = tail + 1;
+    return true;
+}
+
+bool record_ring_wait(uint32_t timeout)
+{
+    if (s_tail == s_head)
+    {
+        ulTaskNotifyTake(pdTRUE, timeout);
+    }
+    return s_tail != s_head;
+}
+
+uint32_t record_ring_count(void)
+{
+    return s_head - s_tail;
+}
@@ -0,0 +1,74 @@
+/*
+ * Single producer, single consumer ring of measurement records
+ * passed from measurement task to main task (or to supervisor,
+ * when it took over before forced sleep).
+ * record_ring.h
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#ifndef MAIN_RECORD_RING_H_
+#define MAIN_RECORD_RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "storage.h"
+#include "humtemp.h"
+#include "measurements.h"
+
+/**
+ * Capacity of ring (power of 2).
+ */
+#define RECORD_RING_SIZE    8
+
+typedef enum
+{
+    REC_MEASUREMENT,    /**< Measurement (or aggregation window) of all sensors. */
+    REC_FINISHED,       /**< All planned measurements done, no samples. */
+} RecordType_t;
+
+/**
+ * Result of measurement of all sensors.
+ * Samples are timestamped when taken, sensor which failed
+ * has no samples.
+ */
+typedef struct
+{
+    StorageSample_t samples[MEAS_WINDOW_SAMPLES * HUMTEMP_CHANNELS];
+    uint8_t type;       /**< See RecordType_t. */
+    uint8_t count;      /**< Number of samples used. */
+    uint16_t reads;     /**< Sensor reads done for this record. */
+    uint16_t errors;    /**< Sensor reads that failed. */
+} MeasRecord_t;
+
+/**
+ * Prepare ring. Must be called by consumer task
+ * (it is woken up when record is added).
+ */
+void record_ring_init(void);
+/**
+ * Add record (producer).
+ * @return false if ring is full and record was dropped
+ */
+bool record_ring_push(const MeasRecord_t * record);
+/**
+ * Take oldest record (consumer).
+ * @param record output
+ * @param timeout how long to wait for record [ticks]
+ * @return false if there was no record
+ */
+bool record_ring_pop(MeasRecord_t * record, uint32_t timeout);
+/**
+ * Wait until there is record in ring, without taking it (consumer).
+ * @param timeout how long to wait [ticks]
+ * @return false if there was no record
+ */
+bool record_ring_wait(uint32_t timeout);
+/**
+ * Number of records waiting in ring.
+ */
+uint32_t record_ring_count(void);
+
+#endif /* MAIN_RECORD_RING_H_ */
@@ -5,12 +5,18 @@
  *      Author: andrzej
  */
 
+#include <stdlib.h>
+#include <stdbool.h>
+
 #include "rtc.h"
 
 #include "storage.h"
 
+#include "freertos/FreeRTOS.h"
+
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "driver/rtc.h"
 
@@ -19,11 +25,58 @@
 #define RTC_MEM_SIZE    512
 #define RTC_MEM_RESERVED 12
 #define STORE_DATA_OFFSET 2
+#define STORE_WORDS_OFFSET (STORE_DATA_OFFSET + 2 * MEAS_STORAGE_BANK_SIZE)
 
-#define SLEEP_TIME_CORRECTION 16
+/**
+ * Initial drift of deep sleep timer, units used to wake about
+ * 16 seconds early from 3 minute sleep.
+ */
+#define DRIFT_DEFAULT_PPM   (-88889)
+/**
+ * Drift estimate is kept within that range [ppm].
+ */
+#define DRIFT_MAX_PPM       200000
+/**
+ * Shortest time between server corrections used
+ * for drift fitting [s].
+ */
+#define DRIFT_MIN_SPAN_S    1800
+/**
+ * Correction smaller than that [ms] (or than accuracy of
+ * server time) is not applied at all.
+ */
+#define DRIFT_DEADBAND_MS   500
+/**
+ * Weight of new observation (1/N) in drift average.
+ */
+#define DRIFT_EWMA_DIV      4
+/**
+ * Timestamps below that are not real time (clock not set).
+ */
+#define TIME_VALID_MIN      1000000000UL
 
-uint32_t s_time;
-uint32_t s_time_rtc;
+/**
+ * Monotonic time since reset [us], advanced by RTC cycle deltas.
+ */
+static uint64_t s_mono_us;
+/**
+ * RTC cycle counter at last update of s_mono_us.
+ */
+static uint32_t s_mono_cycles;
+/**
+ * Wall clock time = monotonic time + offset [ms].
+ */
+static int64_t s_wall_offset_ms;
+
+static int32_t s_drift_ppm = DRIFT_DEFAULT_PPM;
+/**
+ * Server time of last drift fit (0 - none).
+ */
+static uint32_t s_sync_ts = 0;
+/**
+ * Sum of clock corrections since last drift fit [ms].
+ */
+static int32_t s_sync_error_ms = 0;
 
 static inline uint32_t read_rtc_mem(uint32_t dwordIdx)
 {
@@ -35,9 +88,24 @@ static inline void write_rtc_mem(uint32_t dwordIdx, uint32_t value)
     ((volatile uint32_t *) 0x60001200)[dwordIdx] = value;
 }
 
-static inline uint32_t get_rtc_timestamp(void)
+/**
+ * Advance monotonic time by RTC cycles counted since last call.
+ * Difference of 32-bit counters survives its wrap. Cycles are
+ * not consumed until they add up to a microsecond, so frequent
+ * calls do not lose time.
+ */
+static uint64_t mono_update(void)
 {
-    return rtc_clk_to_us(rtc_time_get(), pm_rtc_clock_cali_proc());
+    uint32_t now = rtc_time_get();
+    uint32_t dc = now - s_mono_cycles;
+    uint32_t dus = rtc_clk_to_us(dc, pm_rtc_clock_cali_proc());
+
+    if (dus)
+    {
+        s_mono_us += dus;
+        s_mono_cycles = now;
+    }
+    return s_mono_us;
 }
 
 static void init_data_bank(void)
@@ -52,6 +120,16 @@ static void init_data_bank(void)
     }
 }
 
+static void init_words(void)
+{
+    assert(((STORE_WORDS_OFFSET + RTC_WORD_COUNT) * sizeof(uint32_t)) <= RTC_MEM_SIZE);
+
+    for (int i = 0; i < RTC_WORD_COUNT; ++i)
+    {
+        write_rtc_mem(STORE_WORDS_OFFSET + i, 0);
+    }
+}
+
 void time_init(void)
 {
     /* check if RTC memory is initialized by us */
@@ -60,63 +138,193 @@ void time_init(void)
         /* second word of memory should contain timestamp saved by us
          * before going into deep-sleep. Therefore we need to assume
          * that time now is time then plus however sleep lasts. */
-        s_time = read_rtc_mem(1);
+        s_wall_offset_ms = (int64_t) read_rtc_mem(1) * 1000LL;
     }
     else
     {
         /* no timestamp information available (cold reset probably)
          * initialize to zero. */
-        s_time = 0;
+        s_wall_offset_ms = 0;
+    }
+
+    /* monotonic time counts from reset, saved timestamp
+     * was planned time of wake (reset) */
+    s_mono_us = (uint64_t) esp_timer_get_time();
+    s_mono_cycles = rtc_time_get();
+
+    if (0 != storage_drift_get(&s_drift_ppm, &s_sync_ts, &s_sync_error_ms))
+    {
+        s_drift_ppm = DRIFT_DEFAULT_PPM;
+        s_sync_ts = 0;
+        s_sync_error_ms = 0;
     }
-    s_time_rtc = get_rtc_timestamp();
+}
+
+uint64_t rtc_monotonic_ms(void)
+{
+    uint64_t us;
+
+    portENTER_CRITICAL();
+    us = mono_update();
+    portEXIT_CRITICAL();
+
+    return us / 1000ULL;
+}
+
+int64_t rtc_wall_ms(void)
+{
+    return (int64_t) rtc_monotonic_ms() + s_wall_offset_ms;
+}
+
+void rtc_set_wall_ms(int64_t wall_ms)
+{
+    s_wall_offset_ms = wall_ms - (int64_t) rtc_monotonic_ms();
 }
 
 uint32_t get_timestamp(void)
 {
-    uint32_t rtc_now = get_rtc_timestamp();
+    return (uint32_t) (rtc_wall_ms() / 1000LL);
+}
+
+void set_timestamp(uint32_t timestamp)
+{
+    rtc_set_wall_ms((int64_t) timestamp * 1000LL);
+}
+
+static int32_t drift_clamp(int32_t ppm)
+{
+    if (ppm > DRIFT_MAX_PPM)
+    {
+        return DRIFT_MAX_PPM;
+    }
+    if (ppm < -DRIFT_MAX_PPM)
+    {
+        return -DRIFT_MAX_PPM;
+    }
+    return ppm;
+}
+
+void time_sync(int64_t server_ms, uint32_t accuracy_ms)
+{
+    int64_t local_ms = rtc_wall_ms();
+    int64_t error_ms = server_ms - local_ms;
+    uint32_t local = (uint32_t) (local_ms / 1000LL);
+    uint32_t span = local - s_sync_ts;
+    uint32_t tolerance = (accuracy_ms > DRIFT_DEADBAND_MS) ? accuracy_ms : DRIFT_DEADBAND_MS;
+    bool valid = (0 != s_sync_ts) && (local >= TIME_VALID_MIN) && (local > s_sync_ts);
 
-    if (rtc_now >= s_time_rtc)
+    if (valid && (llabs(error_ms) <= tolerance))
     {
-        s_time += ((rtc_now - s_time_rtc) / 1000000UL);
+        /* good enough - no correction, so no new point for fitting
+         * and baseline of next fit gets longer */
+        return;
     }
-    else
+
+    rtc_set_wall_ms(server_ms);
+
+    if (valid && (span < DRIFT_MIN_SPAN_S))
     {
-        s_time += ((((0xFFFFFFFFUL - s_time_rtc) + 1UL) + rtc_now) / 1000000UL);
+        /* too short for fitting - keep its start, remember
+         * correction so that whole error is fitted later */
+        s_sync_error_ms += (int32_t) error_ms;
+        storage_drift_set(s_drift_ppm, s_sync_ts, s_sync_error_ms);
+        return;
     }
 
-    s_time_rtc = rtc_now;
-    return s_time;
+    if (valid)
+    {
+        int64_t total_ms = error_ms + s_sync_error_ms;
+
+        if (llabs(total_ms) < (span * 1000LL) / 4)
+        {
+            /* local clock ran too slow (error > 0) - sleep lasts
+             * longer than assumed, move estimate by part of error */
+            int32_t observed = (int32_t) ((total_ms * 1000LL) / (int64_t) span);
+
+            s_drift_ppm = drift_clamp(s_drift_ppm + observed / DRIFT_EWMA_DIV);
+            ESP_LOGI("time", "drift %d ppm (error %d ms over %u s)", s_drift_ppm, (int) total_ms, span);
+        }
+    }
+
+    s_sync_ts = (uint32_t) (server_ms / 1000LL);
+    s_sync_error_ms = 0;
+    storage_drift_set(s_drift_ppm, s_sync_ts, s_sync_error_ms);
 }
 
-void set_timestamp(uint32_t timestamp)
+void time_exchange(int64_t t0, int64_t t1, int64_t t2, int64_t t3, TimeSyncResult_t * result)
 {
-    s_time = timestamp;
-    s_time_rtc = get_rtc_timestamp();
+    /* NTP: t0 request sent, t1 received by server, t2 response sent
+     * by server, t3 response received; t0, t3 local, t1, t2 server time */
+    int64_t offset = ((t1 - t0) + (t2 - t3)) / 2;
+    int64_t rtt = (t3 - t0) - (t2 - t1);
+
+    if (rtt < 0)
+    {
+        rtt = 0;
+    }
+
+    result->offset_ms = (int32_t) offset;
+    result->rtt_ms = (uint32_t) rtt;
+
+    /* server time at t3 is known within half of round trip */
+    time_sync(rtc_wall_ms() + offset, result->rtt_ms / 2);
+}
+
+uint64_t time_sleep_us(uint32_t sleep_s)
+{
+    /* sleep timer runs (1 + drift) times longer than requested */
+    return ((uint64_t) sleep_s * 1000000ULL * 1000000ULL) / (uint64_t) (1000000L + s_drift_ppm);
+}
+
+int32_t time_drift_ppm(void)
+{
+    return s_drift_ppm;
 }
 
 void save_timestamp(uint32_t add)
 {
-    /* first update it */
-    (void) get_timestamp();
-    if (add > 60)
+    /* sleep length is corrected by time_sleep_us(),
+     * fraction of second is rounded */
+    write_rtc_mem(1, (uint32_t) ((rtc_wall_ms() + 500LL) / 1000LL) + add);
+    if (GNIOT_RTC_MAGIC != read_rtc_mem(0))
+    {
+        init_data_bank();
+        init_words();
+        write_rtc_mem(0, GNIOT_RTC_MAGIC);
+    }
+}
+
+uint32_t rtc_word_get(RtcWord_t word)
+{
+    if ((GNIOT_RTC_MAGIC == read_rtc_mem(0)) && (word < RTC_WORD_COUNT))
     {
-        add -= SLEEP_TIME_CORRECTION;
+        return read_rtc_mem(STORE_WORDS_OFFSET + word);
     }
-    write_rtc_mem(1, s_time + add);
+    return 0;
+}
+
+void rtc_word_set(RtcWord_t word, uint32_t value)
+{
     if (GNIOT_RTC_MAGIC != read_rtc_mem(0))
     {
+        write_rtc_mem(1, 0);
         init_data_bank();
+        init_words();
         write_rtc_mem(0, GNIOT_RTC_MAGIC);
     }
+    if (word < RTC_WORD_COUNT)
+    {
+        write_rtc_mem(STORE_WORDS_OFFSET + word, value);
+    }
 }
 
-
 int save_data_in_rtc(const StorageSample_t * data)
 {
     if (GNIOT_RTC_MAGIC != read_rtc_mem(0))
     {
         write_rtc_mem(1, 0);
         init_data_bank();
+        init_words();
         write_rtc_mem(0, GNIOT_RTC_MAGIC);
     }
     for (int i = 0; i < MEAS_STORAGE_BANK_SIZE; ++i)
@@ -139,6 +347,7 @@ int save_data_in_rtc_at(int idx, const StorageSample_t * data)
     {
         write_rtc_mem(1, 0);
         init_data_bank();
+        init_words();
         write_rtc_mem(0, GNIOT_RTC_MAGIC);
     }
     if (idx < MEAS_STORAGE_BANK_SIZE)
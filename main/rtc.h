@@ -17,8 +17,23 @@
  * Read timestamp from RTC memory.
  */
 void time_init(void);
+/**
+ * Monotonic time since reset [ms].
+ * Does not wrap, not affected by setting time.
+ */
+uint64_t rtc_monotonic_ms(void);
+/**
+ * Current wall clock time [ms since epoch].
+ */
+int64_t rtc_wall_ms(void);
+/**
+ * Set wall clock time.
+ * @param wall_ms current time [ms since epoch]
+ */
+void rtc_set_wall_ms(int64_t wall_ms);
 /**
  * Return current timestamp [s].
+ * Thin wrapper of rtc_wall_ms().
  */
 uint32_t get_timestamp(void);
 /**
@@ -27,8 +42,75 @@ uint32_t get_timestamp(void);
 void set_timestamp(uint32_t timestamp);
 /**
  * Save timestamp to RTC memory.
+ * @param add planned sleep length [s]
  */
 void save_timestamp(uint32_t add);
+/**
+ * Set current time from server and use difference from
+ * local time to correct model of sleep clock drift.
+ * Difference within accuracy is ignored.
+ * @param server_ms server time [ms since epoch]
+ * @param accuracy_ms how much server time can be wrong [ms]
+ */
+void time_sync(int64_t server_ms, uint32_t accuracy_ms);
+
+/**
+ * Result of time exchange with server.
+ */
+typedef struct
+{
+    int32_t offset_ms;  /**< Server time minus local time. */
+    uint32_t rtt_ms;    /**< Round trip time without server processing. */
+} TimeSyncResult_t;
+
+/**
+ * Synchronize time from request/response pair (NTP-style).
+ * Time is set using offset, with accuracy of half of RTT.
+ * @param t0 local time when request was sent [ms]
+ * @param t1 server time when request was received [ms]
+ * @param t2 server time when response was sent [ms]
+ * @param t3 local time when response was received [ms]
+ * @param result output - offset and round trip time
+ */
+void time_exchange(int64_t t0, int64_t t1, int64_t t2, int64_t t3, TimeSyncResult_t * result);
+/**
+ * Get time to request from deep sleep timer, so that
+ * sleep really takes given time (corrected for drift).
+ * @param sleep_s wanted sleep length [s]
+ * @return sleep timer value [us]
+ */
+uint64_t time_sleep_us(uint32_t sleep_s);
+/**
+ * Current estimate of sleep clock error [ppm],
+ * positive when deep sleep lasts longer than requested.
+ */
+int32_t time_drift_ppm(void);
+
+/**
+ * Single words of RTC memory kept over deep sleep
+ * for modules that need to remember something between wakes.
+ */
+typedef enum
+{
+    RTC_WORD_SCHED,         /**< Sleep scheduler state. */
+    RTC_WORD_ENERGY_CHARGE, /**< Charge used since last report. */
+    RTC_WORD_ENERGY_COUNT,  /**< Wakes and samples since last report. */
+    RTC_WORD_DB_TS,         /**< Time of last deadband heartbeat. */
+    RTC_WORD_DB_VAL0,       /**< Last reported measurement of channel 0. */
+    RTC_WORD_DB_VAL1,       /**< Last reported measurement of channel 1. */
+    RTC_WORD_ENERGY_SLEEP,  /**< Time of last going to sleep [ms]. */
+    RTC_WORD_LOST,          /**< Records lost by forced sleeps, not reported yet. */
+    RTC_WORD_COUNT
+} RtcWord_t;
+
+/**
+ * Read word from RTC memory (0 if memory not initialized).
+ */
+uint32_t rtc_word_get(RtcWord_t word);
+/**
+ * Write word to RTC memory.
+ */
+void rtc_word_set(RtcWord_t word, uint32_t value);
 
 int save_data_in_rtc(const StorageSample_t * data);
 int save_data_in_rtc_at(int idx, const StorageSample_t * data);
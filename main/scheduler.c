@@ -0,0 +1,205 @@
+/*
+ * Adaptive sleep scheduler.
+ * scheduler.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include <stdio.h>
+
+#include "scheduler.h"
+#include "storage.h"
+#include "rtc.h"
+#include "debug.h"
+
+/**
+ * Below this signal strength [dBm] link is considered weak.
+ */
+#define SCHED_RSSI_WEAK         (-80)
+/**
+ * Connect longer than that [ms] means link is weak.
+ */
+#define SCHED_CONNECT_SLOW_MS   5000
+/**
+ * Maximum exponent of back-off after failed uploads.
+ */
+#define SCHED_MAX_BACKOFF       3
+/**
+ * Timestamps below that mean time was never set by server
+ * and upload slot can not be used.
+ */
+#define SCHED_TIME_VALID        1000000000UL
+
+/*
+ * Scheduler state kept in RTC memory:
+ *  bits 0-7   consecutive failed wakes
+ *  bit 8      do not connect on next wake
+ *  bit 9      link was weak last time we connected
+ *  bits 12-15 reason of last decision
+ *  bits 16-31 last sleep length [min]
+ */
+#define SCHED_FAILS(W)          ((W) & 0xFF)
+#define SCHED_SKIP_CONNECT      (1UL << 8)
+#define SCHED_WEAK_LINK         (1UL << 9)
+#define SCHED_REASON(W)         (((W) >> 12) & 0xF)
+#define SCHED_SLEEP(W)          ((W) >> 16)
+
+/**
+ * Reason of decision, reported to server.
+ */
+enum {
+    SCHED_R_FIXED,      /**< Scheduler disabled, fixed sleep. */
+    SCHED_R_BASE,       /**< Nothing special. */
+    SCHED_R_VDD,        /**< Low supply voltage. */
+    SCHED_R_FAIL,       /**< Back-off after failure. */
+    SCHED_R_WEAK,       /**< Weak link, batching samples. */
+    SCHED_R_DRAIN,      /**< Large backlog on good link. */
+};
+
+static const char s_reason_chars[] = "xbvfwd";
+
+bool scheduler_should_connect(void)
+{
+    return !(rtc_word_get(RTC_WORD_SCHED) & SCHED_SKIP_CONNECT);
+}
+
+static uint32_t clamp(uint32_t v, uint32_t lo, uint32_t hi)
+{
+    if (v < lo) return lo;
+    if (v > hi) return hi;
+    return v;
+}
+
+/**
+ * Adjust sleep, so next wake happens in upload slot assigned
+ * by server. Slot is an offset [s] within fixed cycle of configured
+ * sleep length, so it does not move when scheduler lengthens
+ * or shortens sleep. Wake goes to slot nearest to planned one,
+ * result is kept between half and one and a half of planned sleep.
+ */
+static uint32_t align_to_slot(uint32_t sleep_s)
+{
+    const GniotConfig_t * cfg = config_get();
+    uint16_t slot = cfg->upload_slot;
+    uint32_t cycle = cfg->sleep_length * 60U;
+    /* nearest second, sleep is planned in whole seconds */
+    uint32_t now = (uint32_t) ((rtc_wall_ms() + 500LL) / 1000LL);
+    uint32_t phase;
+    int32_t aligned;
+
+    if ((UPLOAD_SLOT_NONE == slot) || (now < SCHED_TIME_VALID) || (cycle < 2) || (sleep_s < 2))
+    {
+        return sleep_s;
+    }
+
+    /* time of planned wake since last slot */
+    phase = (now % cycle + sleep_s % cycle + cycle - slot % cycle) % cycle;
+    aligned = (int32_t) sleep_s + ((phase > cycle / 2) ? (int32_t) (cycle - phase) : -(int32_t) phase);
+
+    if (aligned < (int32_t) (sleep_s / 2))
+    {
+        aligned = sleep_s / 2;
+    }
+    else if (aligned > (int32_t) (sleep_s + sleep_s / 2))
+    {
+        aligned = sleep_s + sleep_s / 2;
+    }
+
+    DBG_PRINTF("Slot %u/%u: sleep %u s -> %d s\n", (unsigned) slot, cycle, sleep_s, aligned);
+    return (uint32_t) aligned;
+}
+
+uint32_t scheduler_next_sleep(const SchedInput_t * in)
+{
+    const GniotConfig_t * cfg = config_get();
+    uint32_t state = rtc_word_get(RTC_WORD_SCHED);
+    uint32_t fails = SCHED_FAILS(state);
+    bool weak = (state & SCHED_WEAK_LINK) != 0;
+    bool skip_connect = false;
+    uint32_t sleep_min = cfg->sleep_length;
+    int reason = SCHED_R_BASE;
+
+    if ((0 == cfg->sleep_max) || (cfg->sleep_max < cfg->sleep_min))
+    {
+        /* not configured by server - keep fixed period */
+        reason = SCHED_R_FIXED;
+        fails = 0;
+        weak = false;
+    }
+    else
+    {
+        if (in->connect_tried)
+        {
+            if (in->upload_ok)
+            {
+                fails = 0;
+                weak = ((in->rssi != 0) && (in->rssi < SCHED_RSSI_WEAK))
+                        || (in->connect_ms > SCHED_CONNECT_SLOW_MS);
+            }
+            else if (fails < 255)
+            {
+                ++fails;
+            }
+        }
+
+        if (in->vdd_mv && cfg->vdd_low && (in->vdd_mv < cfg->vdd_low))
+        {
+            /* save what is left of battery */
+            sleep_min = cfg->sleep_max;
+            skip_connect = cfg->backlog_target && (in->backlog < cfg->backlog_target);
+            reason = SCHED_R_VDD;
+        }
+        else if (fails)
+        {
+            /* server or AP unreachable, back off */
+            sleep_min <<= (fails < SCHED_MAX_BACKOFF) ? fails : SCHED_MAX_BACKOFF;
+            reason = SCHED_R_FAIL;
+        }
+        else if (weak)
+        {
+            /* connecting is expensive, sleep longer and
+             * connect only when enough samples are collected */
+            sleep_min *= 2;
+            skip_connect = cfg->backlog_target && ((in->backlog + 1) < cfg->backlog_target);
+            reason = SCHED_R_WEAK;
+        }
+        else if (cfg->backlog_target && (in->backlog > cfg->backlog_target))
+        {
+            /* good link but samples left, come back soon */
+            sleep_min = cfg->sleep_min;
+            reason = SCHED_R_DRAIN;
+        }
+
+        sleep_min = clamp(sleep_min, cfg->sleep_min, cfg->sleep_max);
+    }
+
+    if (0 == sleep_min)
+    {
+        sleep_min = 1;
+    }
+
+    DBG_PRINTF("Scheduler: backlog %d conn %u ms rssi %d vdd %u fails %u -> %u min (%c)%s\n",
+            in->backlog, in->connect_ms, in->rssi, in->vdd_mv, fails, sleep_min,
+            s_reason_chars[reason], skip_connect ? " offline" : "");
+
+    state = (fails & 0xFF) | (skip_connect ? SCHED_SKIP_CONNECT : 0)
+            | (weak ? SCHED_WEAK_LINK : 0) | (((uint32_t) reason) << 12)
+            | ((sleep_min & 0xFFFF) << 16);
+    rtc_word_set(RTC_WORD_SCHED, state);
+
+    return align_to_slot(sleep_min * 60);
+}
+
+void scheduler_report(Request_t * request)
+{
+    uint32_t state = rtc_word_get(RTC_WORD_SCHED);
+    char buf[16];
+
+    if (state)
+    {
+        sprintf(buf, "%u:%u:%c", (unsigned) SCHED_SLEEP(state), (unsigned) SCHED_FAILS(state),
+                s_reason_chars[SCHED_REASON(state) % (sizeof(s_reason_chars) - 1)]);
+        request_sets(request, "sched", buf);
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * Adaptive sleep scheduler.
+ * Decides how long to sleep and whether to connect on next wake.
+ * scheduler.h
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#ifndef MAIN_SCHEDULER_H_
+#define MAIN_SCHEDULER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "client.h"
+
+/**
+ * What happened during this wake.
+ */
+typedef struct
+{
+    int backlog;            /**< Samples waiting in storage. */
+    bool connect_tried;     /**< Wifi connection was attempted. */
+    bool upload_ok;         /**< At least one upload succeeded. */
+    uint32_t connect_ms;    /**< Time of wifi connect [ms]. */
+    int rssi;               /**< Signal strength [dBm], 0 - unknown. */
+    uint32_t vdd_mv;        /**< Supply voltage [mV], 0 - unknown. */
+} SchedInput_t;
+
+/**
+ * Should we connect to wifi during this wake?
+ * (false if previous decision was to batch samples offline)
+ */
+bool scheduler_should_connect(void);
+/**
+ * Compute next sleep length and remember decision for next wake.
+ * @param in inputs collected during wake
+ * @return sleep length [s]
+ */
+uint32_t scheduler_next_sleep(const SchedInput_t * in);
+/**
+ * Longest text added by scheduler_report [B].
+ */
+#define SCHED_REPORT_MAX        22
+/**
+ * Append previous decision to request sent to server.
+ */
+void scheduler_report(Request_t * request);
+
+#endif /* MAIN_SCHEDULER_H_ */
@@ -16,9 +16,41 @@
 #include "client.h"
 #include "ota.h"
 #include "rtc.h"
+#include "power.h"
+#include "scheduler.h"
+#include "energy.h"
+#include "supervisor.h"
+#include "measurements.h"
+#include "debug.h"
+
+#include "esp_timer.h"
 
 #define DEFAULT_PORT    80
 
+/*
+ * Longest texts of measurement upload [B]: "GET /kloc?id=<id>",
+ * measurement or extension key with value (&hi3_<ts>=<value>),
+ * window count (&n3_<ts>=<count>), drift, sync_off and sync_rtt, t0.
+ */
+#define UPLOAD_HEAD_MAX         23
+#define UPLOAD_SAMPLE_MAX       26
+#define UPLOAD_COUNT_MAX        20
+#define UPLOAD_SYNC_MAX         (18 + 21 + 20)
+#define UPLOAD_T0_MAX           19
+/**
+ * Worst case of live upload: all samples of one window on every channel
+ * with all reports.
+ */
+#define UPLOAD_LIVE_MAX         (UPLOAD_HEAD_MAX \
+        + HUMTEMP_CHANNELS * (MEAS_WINDOW_SAMPLES * UPLOAD_SAMPLE_MAX + UPLOAD_COUNT_MAX) \
+        + SCHED_REPORT_MAX + UPLOAD_SYNC_MAX + ENERGY_REPORT_MAX \
+        + SUPERVISOR_REPORT_MAX + OTA_REPORT_MAX \
+        + UPLOAD_T0_MAX + CLIENT_REQUEST_FRAME_MAX)
+
+#if UPLOAD_LIVE_MAX > CLIENT_REQUEST_SIZE
+#error "CLIENT_REQUEST_SIZE too small for measurement upload"
+#endif
+
 enum {
     S_CMD_DUMP_CFG,
     S_CMD_OTA,
@@ -98,6 +130,40 @@ static const char * get_address(const char * val, uint16_t * port)
     return add_buf;
 }
 
+/**
+ * Time exchange of current request.
+ */
+static struct
+{
+    int64_t t0;             /**< Local time of sending request [ms]. */
+    int64_t t1;             /**< Server time of receiving request [ms]. */
+    int64_t t2;             /**< Server time of sending response [ms]. */
+    uint32_t timestamp;     /**< Server time [s] (without exchange). */
+    bool done;              /**< Exchange done in this wake. */
+    TimeSyncResult_t result;
+} s_sync;
+
+/**
+ * Parse time in format <seconds>[.<milliseconds>].
+ * @return time [ms]
+ */
+static int64_t parse_ms(const char * val)
+{
+    char * end;
+    int64_t ms = (int64_t) strtoul(val, &end, 10) * 1000LL;
+
+    if ('.' == *end)
+    {
+        int scale = 100;
+
+        for (++end; (*end >= '0') && (*end <= '9') && scale; ++end, scale /= 10)
+        {
+            ms += (*end - '0') * scale;
+        }
+    }
+    return ms;
+}
+
 /**
  * Handler for server commands.
  */
@@ -107,18 +173,27 @@ void command_handler(const char * key, const char * val)
 
     if (0 == strcmp("timestamp", key))
     {
-        printf("Timestamp: %s\n", val);
-        set_timestamp((uint32_t) atoll(val));
+        DBG_PRINTF("Timestamp: %s\n", val);
+        /* applied after response, if there is no exchange */
+        s_sync.timestamp = (uint32_t) atoll(val);
+    }
+    else if (0 == strcmp("t1", key))
+    {
+        s_sync.t1 = parse_ms(val);
+    }
+    else if (0 == strcmp("t2", key))
+    {
+        s_sync.t2 = parse_ms(val);
     }
     else if (0 == strcmp("new_server", key))
     {
         const char * address;
         uint16_t port;
-        printf("%s -> %s\n", key, val);
+        DBG_PRINTF("%s -> %s\n", key, val);
         address = get_address(val, &port);
         if (NULL == address)
         {
-            printf("Invalid address\n");
+            DBG_PRINTF("Invalid address\n");
         }
         else
         {
@@ -129,64 +204,162 @@ void command_handler(const char * key, const char * val)
     else if (0 == strcmp("your_id", key))
     {
         int iv = atoi(val);
-        printf("%s -> %s\n", key, val);
+        DBG_PRINTF("%s -> %s\n", key, val);
         config_set_myid((uint32_t) iv);
     }
     else if (0 == strcmp("samples_per_measure", key))
     {
         int iv = atoi(val);
-        printf("%s -> %s\n", key, val);
+        DBG_PRINTF("%s -> %s\n", key, val);
         config_set_measure(cfg->measure_period, (uint16_t) iv);
     }
     else if (0 == strcmp("measure_period", key))
     {
         int iv = atoi(val);
-        printf("%s -> %s\n", key, val);
+        DBG_PRINTF("%s -> %s\n", key, val);
         config_set_measure((uint16_t) iv, cfg->samples_per_measure);
     }
+    else if (0 == strcmp("converge_tol", key))
+    {
+        int iv = atoi(val);
+        DBG_PRINTF("%s -> %s\n", key, val);
+        config_set_converge_tol((uint16_t) iv);
+    }
+    else if (0 == strcmp("estimator", key))
+    {
+        int iv = atoi(val);
+        DBG_PRINTF("%s -> %s\n", key, val);
+        config_set_estimator((uint16_t) iv);
+    }
+    else if (0 == strcmp("agg_window", key))
+    {
+        int iv = atoi(val);
+        DBG_PRINTF("%s -> %s\n", key, val);
+        config_set_agg_window((uint16_t) iv);
+    }
+    else if (0 == strcmp("deadband_h", key))
+    {
+        int iv = atoi(val);
+        DBG_PRINTF("%s -> %s\n", key, val);
+        config_set_deadband((uint16_t) iv, cfg->deadband_t, cfg->heartbeat);
+    }
+    else if (0 == strcmp("deadband_t", key))
+    {
+        int iv = atoi(val);
+        DBG_PRINTF("%s -> %s\n", key, val);
+        config_set_deadband(cfg->deadband_h, (uint16_t) iv, cfg->heartbeat);
+    }
+    else if (0 == strcmp("heartbeat", key))
+    {
+        int iv = atoi(val);
+        DBG_PRINTF("%s -> %s\n", key, val);
+        config_set_deadband(cfg->deadband_h, cfg->deadband_t, (uint16_t) iv);
+    }
     else if (0 == strcmp("measures_per_sleep", key))
     {
         int iv = atoi(val);
-        printf("%s -> %s\n", key, val);
+        DBG_PRINTF("%s -> %s\n", key, val);
         config_set_sleep((uint16_t) iv, cfg->sleep_length);
     }
     else if (0 == strcmp("sleep_length", key))
     {
         int iv = atoi(val);
-        printf("%s -> %s\n", key, val);
+        DBG_PRINTF("%s -> %s\n", key, val);
         config_set_sleep(cfg->measures_per_sleep, (uint16_t) iv);
     }
+    else if (0 == strcmp("wake_budget", key))
+    {
+        int iv = atoi(val);
+        DBG_PRINTF("%s -> %s\n", key, val);
+        config_set_wake_budget((uint16_t) iv);
+    }
+    else if (0 == strcmp("sleep_min", key))
+    {
+        int iv = atoi(val);
+        DBG_PRINTF("%s -> %s\n", key, val);
+        config_set_sched((uint16_t) iv, cfg->sleep_max, cfg->backlog_target, cfg->vdd_low);
+    }
+    else if (0 == strcmp("sleep_max", key))
+    {
+        int iv = atoi(val);
+        DBG_PRINTF("%s -> %s\n", key, val);
+        config_set_sched(cfg->sleep_min, (uint16_t) iv, cfg->backlog_target, cfg->vdd_low);
+    }
+    else if (0 == strcmp("backlog_target", key))
+    {
+        int iv = atoi(val);
+        DBG_PRINTF("%s -> %s\n", key, val);
+        config_set_sched(cfg->sleep_min, cfg->sleep_max, (uint16_t) iv, cfg->vdd_low);
+    }
+    else if (0 == strcmp("vdd_low", key))
+    {
+        int iv = atoi(val);
+        DBG_PRINTF("%s -> %s\n", key, val);
+        config_set_sched(cfg->sleep_min, cfg->sleep_max, cfg->backlog_target, (uint16_t) iv);
+    }
+    else if (0 == strcmp("slot", key))
+    {
+        int iv = atoi(val);
+        DBG_PRINTF("%s -> %s\n", key, val);
+        config_set_upload_slot((iv >= 0) ? (uint16_t) iv : UPLOAD_SLOT_NONE);
+    }
+    else if (0 == strcmp("current_model", key))
+    {
+        unsigned radio, cpu, cpu_fast, sleep;
+        DBG_PRINTF("%s -> %s\n", key, val);
+        if (4 == sscanf(val, "%u,%u,%u,%u", &radio, &cpu, &cpu_fast, &sleep))
+        {
+            config_set_current_model(radio, cpu, cpu_fast, sleep);
+        }
+    }
     else if (0 == strcmp("switch_server", key))
     {
-        printf("switch server \n\t (%s %d) <-> (%s %d)\n",
+        DBG_PRINTF("switch server \n\t (%s %d) <-> (%s %d)\n",
                 cfg->server_address, (int) cfg->server_port,
                 cfg->fallback_server_address, (int) cfg-> fallback_server_port);
         config_switch_server();
     }
     else if (0 == strcmp("do_ota", key))
     {
-        printf("do_ota requested\n");
+        DBG_PRINTF("do_ota requested\n");
         CMD_SET(S_CMD_OTA);
     }
     else if (0 == strcmp("dump_cfg", key))
     {
-        printf("dump_cfg requested\n");
+        DBG_PRINTF("dump_cfg requested\n");
         CMD_SET(S_CMD_DUMP_CFG);
     }
     else if (0 == strcmp("clear_store", key))
     {
-        printf("clear_store requested\n");
+        DBG_PRINTF("clear_store requested\n");
         storage_clear();
     }
 }
 
+/**
+ * Send part of configuration dump and close connection.
+ */
+static void dump_send(Request_t * request)
+{
+    const char * reqs = request_make(request);
+
+    /* no request when it does not fit */
+    if (NULL != reqs)
+    {
+        client_request(reqs, strlen(reqs));
+    }
+    client_close();
+}
+
+/**
+ * Send configuration to server, in two requests
+ * (connection settings and measurement, then sleep and energy).
+ */
 static void dump_config(const GniotConfig_t * cfg)
 {
     Request_t request;
-    const char * reqs;
-    int r = client_open();
 
-    if (!r)
+    if (!client_open())
     {
         request_new(&request, "/kloc");
         request_sets(&request, "server_address", cfg->server_address);
@@ -196,29 +369,155 @@ static void dump_config(const GniotConfig_t * cfg)
         request_seti(&request, "measure_period", cfg->measure_period);
         request_seti(&request, "measures_per_sleep", cfg->measures_per_sleep);
         request_seti(&request, "samples_per_measure", cfg->samples_per_measure);
+        request_seti(&request, "converge_tol", cfg->converge_tol);
+        request_seti(&request, "estimator", cfg->estimator);
+        request_seti(&request, "agg_window", cfg->agg_window);
+        request_seti(&request, "deadband_h", cfg->deadband_h);
+        request_seti(&request, "deadband_t", cfg->deadband_t);
+        request_seti(&request, "heartbeat", cfg->heartbeat);
+        dump_send(&request);
+    }
+
+    if (!client_open())
+    {
+        request_new(&request, "/kloc");
         request_seti(&request, "sleep_length", cfg->sleep_length);
-        reqs = request_make(&request);
-        client_request(reqs, strlen(reqs));
-        client_close();
+        request_seti(&request, "wake_budget", cfg->wake_budget);
+        request_setu(&request, "budget_overruns", storage_overrun_get());
+        request_seti(&request, "sleep_min", cfg->sleep_min);
+        request_seti(&request, "sleep_max", cfg->sleep_max);
+        request_seti(&request, "backlog_target", cfg->backlog_target);
+        request_seti(&request, "vdd_low", cfg->vdd_low);
+        request_seti(&request, "slot", (cfg->upload_slot == UPLOAD_SLOT_NONE) ? -1 : cfg->upload_slot);
+        request_seti(&request, "current_radio", cfg->current_radio);
+        request_seti(&request, "current_cpu", cfg->current_cpu);
+        request_seti(&request, "current_cpu_fast", cfg->current_cpu_fast);
+        request_seti(&request, "current_sleep", cfg->current_sleep);
+        dump_send(&request);
+    }
+}
+
+/**
+ * Send request with local send time, handle response
+ * and set time from it.
+ * @return 0 on success
+ */
+static int exchange(Request_t * request)
+{
+    char t0buf[16];
+    const char * rs;
+    int r;
+
+    s_sync.t0 = rtc_wall_ms();
+    s_sync.t1 = 0;
+    s_sync.t2 = 0;
+    s_sync.timestamp = 0;
+    sprintf(t0buf, "%u.%03u", (unsigned) (s_sync.t0 / 1000LL), (unsigned) (s_sync.t0 % 1000LL));
+    request_sets(request, "t0", t0buf);
+
+    rs = request_make(request);
+    /* no request when connection failed */
+    r = (NULL != rs) ? client_request(rs, strlen(rs)) : -1;
+    if (!r)
+    {
+        r = client_response_iterate(command_handler);
+    }
+
+    if (s_sync.t1 && s_sync.t2 && client_response_time_ms())
+    {
+        time_exchange(s_sync.t0, s_sync.t1, s_sync.t2, client_response_time_ms(), &s_sync.result);
+        s_sync.done = true;
+        DBG_PRINTF("Time sync: offset %d ms, rtt %u ms\n", s_sync.result.offset_ms, s_sync.result.rtt_ms);
+    }
+    else if (s_sync.timestamp)
+    {
+        /* old server - accuracy unknown */
+        time_sync(s_sync.timestamp * 1000LL, 1000);
+    }
+
+    return r;
+}
+
+/**
+ * Timestamp of last measurement put into request, per channel.
+ * Aggregation extensions refer to it.
+ */
+static uint32_t s_last_ts[1 << (32 - SAMPLE_CHANNEL_SHIFT)];
+
+/**
+ * Add sample to request.
+ * Key is m_<ts> for first sensor and m<channel>_<ts> for others,
+ * channel bits are removed from value.
+ * Extension of aggregated measurement adds n_<ts> (count),
+ * lo_<ts> or hi_<ts> (with channel after prefix for other sensors),
+ * where ts is timestamp of the measurement.
+ */
+static void request_sample(Request_t * request, const StorageSample_t * sample)
+{
+    char keybuf[16];
+    uint32_t ch = SAMPLE_CHANNEL(sample->data);
+    const char * prefix = "m";
+    uint32_t ts = sample->ts;
+
+    if (SAMPLE_IS_EXT(ts))
+    {
+        ts = s_last_ts[ch];
+    }
+    else
+    {
+        s_last_ts[ch] = ts;
+    }
+
+    if (SAMPLE_IS_EXT(sample->ts))
+    {
+        if (SAMPLE_EXT_MIN == SAMPLE_EXT_KIND(sample->ts))
+        {
+            /* count goes only once per window */
+            if (ch)
+            {
+                sprintf(keybuf, "n%u_%u", ch, ts);
+            }
+            else
+            {
+                sprintf(keybuf, "n_%u", ts);
+            }
+            request_setu(request, keybuf, SAMPLE_EXT_COUNT(sample->ts));
+        }
+        prefix = (SAMPLE_EXT_MIN == SAMPLE_EXT_KIND(sample->ts)) ? "lo" : "hi";
+    }
+
+    if (ch)
+    {
+        sprintf(keybuf, "%s%u_%u", prefix, ch, ts);
+    }
+    else
+    {
+        sprintf(keybuf, "%s_%u", prefix, ts);
+    }
+    request_setu(request, keybuf, SAMPLE_VALUE(sample->data));
+}
+
+/**
+ * Store samples for sending later.
+ */
+static void store_samples(const StorageSample_t * samples, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        storage_save_sample(&samples[i]);
     }
 }
 
-void service_send(int connection_status, uint32_t measurement)
+int service_send(int connection_status, const StorageSample_t * samples, int count)
 {
     bool clear_storage = false;
+    int result = -1;
 
     storage_sample_start();
 
     if (connection_status)
     {
-        if (NO_MEASUREMENT != measurement)
-        {
-            StorageSample_t store_sample = {
-                    .data = measurement,
-                    .ts = get_timestamp(),
-            };
-            storage_save_sample(&store_sample);
-        }
+        store_samples(samples, count);
     }
     else
     {
@@ -226,11 +525,15 @@ void service_send(int connection_status, uint32_t measurement)
         int r;
         int stored_read = 0;
         Request_t request;
-        char keybuf[14];
-        const char * rs;
+        int64_t start_us;
 
         CMD_CLEAR_ALL();
 
+        /* backlog encoding and upload run at high clock */
+        power_boost_begin();
+        energy_phase_begin(ENERGY_PH_UPLOAD);
+        start_us = esp_timer_get_time();
+
         /* send old samples */
         do
         {
@@ -244,24 +547,17 @@ void service_send(int connection_status, uint32_t measurement)
                 clear_storage = true;
                 r = client_open();
                 request_new(&request, "/kloc");
-                sprintf(keybuf, "m_%u", stored.ts);
-                request_setu(&request, keybuf, stored.data);
+                request_sample(&request, &stored);
 
                 for (si = 1; !stored_read && si < 10; ++si)
                 {
                     stored_read = storage_next(&stored);
                     if (!stored_read)
                     {
-                        sprintf(keybuf, "m_%u", stored.ts);
-                        request_setu(&request, keybuf, stored.data);
+                        request_sample(&request, &stored);
                     }
                 }
-                rs = request_make(&request);
-                r = client_request(rs, strlen(rs));
-                if (!r)
-                {
-                    r = client_response_iterate(command_handler);
-                }
+                r = exchange(&request);
                 client_close();
             }
         } while (!r && !stored_read);
@@ -273,44 +569,56 @@ void service_send(int connection_status, uint32_t measurement)
             r = client_open();
             request_new(&request, "/kloc");
 
-            if (NO_MEASUREMENT != measurement)
+            for (int i = 0; i < count; ++i)
             {
-                char keybuf[14];
-                sprintf(keybuf, "m_%u", get_timestamp());
-                request_setu(&request, keybuf, measurement);
+                request_sample(&request, &samples[i]);
             }
+            scheduler_report(&request);
+            request_seti(&request, "drift", time_drift_ppm());
+            if (s_sync.done)
+            {
+                /* accuracy of time set in this wake */
+                request_seti(&request, "sync_off", s_sync.result.offset_ms);
+                request_setu(&request, "sync_rtt", s_sync.result.rtt_ms);
+            }
+            energy_report(&request);
+            supervisor_report(&request);
+            ota_report(&request);
 
-            rs = request_make(&request);
+            r = exchange(&request);
+            client_close();
 
-            r = client_request(rs, strlen(rs));
             if (!r)
             {
-                r = client_response_iterate(command_handler);
-
+                energy_report_done();
+                supervisor_report_done();
+                ota_report_done();
             }
-            client_close();
         }
 
 
-        if (r && (NO_MEASUREMENT != measurement))
+        result = r;
+
+        if (r)
         {
-            StorageSample_t store_sample = {
-                    .data = measurement,
-                    .ts = get_timestamp(),
-            };
-            storage_save_sample(&store_sample);
+            store_samples(samples, count);
         }
 
+        DBG_PRINTF("Upload took %u ms @ %u MHz\n",
+                (unsigned) ((esp_timer_get_time() - start_us) / 1000), power_cpu_mhz());
+        energy_phase_end(ENERGY_PH_UPLOAD);
+        power_boost_end();
+
         if (IS_CMD_SET(S_CMD_OTA))
         {
-            printf("Perform OTA\n");
+            DBG_PRINTF("Perform OTA\n");
             storage_sample_finish(clear_storage);
             do_ota_upgrade("/ota");
-            return;
+            return result;
         }
         if (IS_CMD_SET(S_CMD_DUMP_CFG))
         {
-            printf("Dump cfg\n");
+            DBG_PRINTF("Dump cfg\n");
             dump_config(cfg);
         }
 
@@ -318,5 +626,6 @@ void service_send(int connection_status, uint32_t measurement)
     }
 
     storage_sample_finish(clear_storage);
+    return result;
 }
 
@@ -11,8 +11,19 @@
 
 #include <stdint.h>
 
-#define NO_MEASUREMENT  0xFFFFFFFFUL
+#include "storage.h"
 
-void service_send(int connection_status, uint32_t measurement);
+/**
+ * Send measurements (and stored backlog) to server or store them
+ * if there is no connection.
+ * If there are no measurements, message is sent anyway
+ * to show that device is alive.
+ * @param connection_status 0 if wifi is connected
+ * @param samples timestamped measurements and their extensions
+ *  (see SAMPLE_EXT)
+ * @param count number of samples
+ * @return 0 if data reached server
+ */
+int service_send(int connection_status, const StorageSample_t * samples, int count);
 
 #endif /* MAIN_SERVICE_H_ */
@@ -7,6 +7,9 @@
 
 #include <string.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "storage.h"
@@ -20,30 +23,62 @@
 #define STO_KEY_MY_ID                "my_id"
 #define STO_KEY_SLEEP                "sleep"
 #define STO_KEY_MEAS                 "meas"
+#define STO_KEY_CONVERGE             "conv"
+#define STO_KEY_ESTIMATOR            "estim"
+#define STO_KEY_AGG_WINDOW           "agg"
+#define STO_KEY_DEADBAND             "dband"
+#define STO_KEY_BUDGET               "budget"
+#define STO_KEY_OVERRUNS             "ovr"
+#define STO_KEY_SCHED                "sched"
+#define STO_KEY_SLOT                 "slot"
+#define STO_KEY_CURRENT_MODEL        "imodel"
+#define STO_KEY_DRIFT                "drift"
+#define STO_KEY_DRIFT_ERROR          "drift_err"
+#define STO_KEY_OTA_PROGRESS         "ota_prog"
+#define STO_KEY_OTA_STATS            "ota_stat"
 
 #define STO_KEY_SAMPLE               "m_"
 
 #define DEFAULT_MEASURE_COUNT       3
 #define DEFAULT_MEASURE_PERIOD      60
+#define DEFAULT_CONVERGE_TOL        2
+#define DEFAULT_ESTIMATOR           0
+#define DEFAULT_AGG_WINDOW          1
 #define DEFAULT_MEASURES_PER_SLEEP  1
 #define DEFAULT_SLEEP_LENGTH        3
+#define DEFAULT_WAKE_BUDGET         60
+#define DEFAULT_CURRENT_RADIO       560
+#define DEFAULT_CURRENT_CPU         150
+#define DEFAULT_CURRENT_CPU_FAST    230
+#define DEFAULT_CURRENT_SLEEP       20
 
 
 #define STORAGE_BANK_COUNT  6
 
 static GniotConfig_t s_config;
 
-static struct {
+/**
+ * Session of reading/saving samples.
+ */
+typedef struct {
     nvs_handle handle;
     int bank_idx;
     int sample_idx;
     int first_bank;
     int written_banks;
-} s_store_read = {0,};
+} StoreSession_t;
+
+static StoreSession_t s_store_read = {0,};
+/**
+ * Guards samples (session, RTC buffer and banks) used by main task
+ * and by supervisor saving samples before forced sleep.
+ */
+static SemaphoreHandle_t s_sample_lock = NULL;
 
 void storage_init(void)
 {
     ESP_ERROR_CHECK(nvs_flash_init());
+    s_sample_lock = xSemaphoreCreateMutex();
 }
 
 void config_init(void)
@@ -104,6 +139,47 @@ void config_init(void)
         s_config.measure_period = DEFAULT_MEASURE_PERIOD;
     }
 
+    if (ESP_OK == nvs_get_u32(handle, STO_KEY_CONVERGE, &tmp32))
+    {
+        s_config.converge_tol = (uint16_t) tmp32;
+    }
+    else
+    {
+        s_config.converge_tol = DEFAULT_CONVERGE_TOL;
+    }
+
+    if (ESP_OK == nvs_get_u32(handle, STO_KEY_ESTIMATOR, &tmp32))
+    {
+        s_config.estimator = (uint16_t) tmp32;
+    }
+    else
+    {
+        s_config.estimator = DEFAULT_ESTIMATOR;
+    }
+
+    if (ESP_OK == nvs_get_u32(handle, STO_KEY_AGG_WINDOW, &tmp32))
+    {
+        s_config.agg_window = (uint16_t) tmp32;
+    }
+    else
+    {
+        s_config.agg_window = DEFAULT_AGG_WINDOW;
+    }
+
+    if (ESP_OK == nvs_get_u64(handle, STO_KEY_DEADBAND, &tmp64))
+    {
+        s_config.deadband_h = (uint16_t) tmp64;
+        s_config.deadband_t = (uint16_t) (tmp64 >> 16);
+        s_config.heartbeat = (uint16_t) (tmp64 >> 32);
+    }
+    else
+    {
+        /* deadband filter disabled */
+        s_config.deadband_h = 0;
+        s_config.deadband_t = 0;
+        s_config.heartbeat = 0;
+    }
+
     if (ESP_OK == nvs_get_u32(handle, STO_KEY_SLEEP, &tmp32))
     {
         s_config.measures_per_sleep = (uint16_t) tmp32;
@@ -115,6 +191,55 @@ void config_init(void)
         s_config.sleep_length = DEFAULT_SLEEP_LENGTH;
     }
 
+    if (ESP_OK == nvs_get_u32(handle, STO_KEY_BUDGET, &tmp32))
+    {
+        s_config.wake_budget = (uint16_t) tmp32;
+    }
+    else
+    {
+        s_config.wake_budget = DEFAULT_WAKE_BUDGET;
+    }
+
+    if (ESP_OK == nvs_get_u64(handle, STO_KEY_SCHED, &tmp64))
+    {
+        s_config.sleep_min = (uint16_t) tmp64;
+        s_config.sleep_max = (uint16_t) (tmp64 >> 16);
+        s_config.backlog_target = (uint16_t) (tmp64 >> 32);
+        s_config.vdd_low = (uint16_t) (tmp64 >> 48);
+    }
+    else
+    {
+        /* adaptive sleep disabled */
+        s_config.sleep_min = 0;
+        s_config.sleep_max = 0;
+        s_config.backlog_target = 0;
+        s_config.vdd_low = 0;
+    }
+
+    if (ESP_OK == nvs_get_u32(handle, STO_KEY_SLOT, &tmp32))
+    {
+        s_config.upload_slot = (uint16_t) tmp32;
+    }
+    else
+    {
+        s_config.upload_slot = UPLOAD_SLOT_NONE;
+    }
+
+    if (ESP_OK == nvs_get_u64(handle, STO_KEY_CURRENT_MODEL, &tmp64))
+    {
+        s_config.current_radio = (uint16_t) tmp64;
+        s_config.current_cpu = (uint16_t) (tmp64 >> 16);
+        s_config.current_cpu_fast = (uint16_t) (tmp64 >> 32);
+        s_config.current_sleep = (uint16_t) (tmp64 >> 48);
+    }
+    else
+    {
+        s_config.current_radio = DEFAULT_CURRENT_RADIO;
+        s_config.current_cpu = DEFAULT_CURRENT_CPU;
+        s_config.current_cpu_fast = DEFAULT_CURRENT_CPU_FAST;
+        s_config.current_sleep = DEFAULT_CURRENT_SLEEP;
+    }
+
     nvs_close(handle);
 }
 
@@ -303,6 +428,76 @@ int config_set_measure(uint16_t measure_period, uint16_t samples_per_measure)
     return (int) err;
 }
 
+int config_set_converge_tol(uint16_t converge_tol)
+{
+    nvs_handle handle;
+    esp_err_t err;
+
+    s_config.converge_tol = converge_tol;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+    err = nvs_set_u32(handle, STO_KEY_CONVERGE, (uint32_t) converge_tol);
+
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    return (int) err;
+}
+
+int config_set_estimator(uint16_t estimator)
+{
+    nvs_handle handle;
+    esp_err_t err;
+
+    s_config.estimator = estimator;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+    err = nvs_set_u32(handle, STO_KEY_ESTIMATOR, (uint32_t) estimator);
+
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    return (int) err;
+}
+
+int config_set_agg_window(uint16_t agg_window)
+{
+    nvs_handle handle;
+    esp_err_t err;
+
+    s_config.agg_window = agg_window;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+    err = nvs_set_u32(handle, STO_KEY_AGG_WINDOW, (uint32_t) agg_window);
+
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    return (int) err;
+}
+
+int config_set_deadband(uint16_t deadband_h, uint16_t deadband_t, uint16_t heartbeat)
+{
+    nvs_handle handle;
+    esp_err_t err;
+    uint64_t tmp;
+
+    s_config.deadband_h = deadband_h;
+    s_config.deadband_t = deadband_t;
+    s_config.heartbeat = heartbeat;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+    tmp = (uint64_t) deadband_h;
+    tmp |= ((uint64_t) deadband_t) << 16;
+    tmp |= ((uint64_t) heartbeat) << 32;
+    err = nvs_set_u64(handle, STO_KEY_DEADBAND, tmp);
+
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    return (int) err;
+}
+
 int config_set_sleep(uint16_t measures_per_sleep, uint16_t sleep_length)
 {
     nvs_handle handle;
@@ -323,13 +518,240 @@ int config_set_sleep(uint16_t measures_per_sleep, uint16_t sleep_length)
     return (int) err;
 }
 
+int config_set_wake_budget(uint16_t wake_budget)
+{
+    nvs_handle handle;
+    esp_err_t err;
 
-void storage_sample_start(void)
+    s_config.wake_budget = wake_budget;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+    err = nvs_set_u32(handle, STO_KEY_BUDGET, (uint32_t) wake_budget);
+
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    return (int) err;
+}
+
+int config_set_sched(uint16_t sleep_min, uint16_t sleep_max, uint16_t backlog_target, uint16_t vdd_low)
+{
+    nvs_handle handle;
+    esp_err_t err;
+    uint64_t tmp;
+
+    s_config.sleep_min = sleep_min;
+    s_config.sleep_max = sleep_max;
+    s_config.backlog_target = backlog_target;
+    s_config.vdd_low = vdd_low;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+    tmp = (uint64_t) sleep_min;
+    tmp |= ((uint64_t) sleep_max) << 16;
+    tmp |= ((uint64_t) backlog_target) << 32;
+    tmp |= ((uint64_t) vdd_low) << 48;
+    err = nvs_set_u64(handle, STO_KEY_SCHED, tmp);
+
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    return (int) err;
+}
+
+int config_set_upload_slot(uint16_t upload_slot)
+{
+    nvs_handle handle;
+    esp_err_t err;
+
+    s_config.upload_slot = upload_slot;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+    err = nvs_set_u32(handle, STO_KEY_SLOT, (uint32_t) upload_slot);
+
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    return (int) err;
+}
+
+int config_set_current_model(uint16_t radio, uint16_t cpu, uint16_t cpu_fast, uint16_t sleep)
+{
+    nvs_handle handle;
+    esp_err_t err;
+    uint64_t tmp;
+
+    s_config.current_radio = radio;
+    s_config.current_cpu = cpu;
+    s_config.current_cpu_fast = cpu_fast;
+    s_config.current_sleep = sleep;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+    tmp = (uint64_t) radio;
+    tmp |= ((uint64_t) cpu) << 16;
+    tmp |= ((uint64_t) cpu_fast) << 32;
+    tmp |= ((uint64_t) sleep) << 48;
+    err = nvs_set_u64(handle, STO_KEY_CURRENT_MODEL, tmp);
+
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    return (int) err;
+}
+
+int storage_drift_get(int32_t * drift_ppm, uint32_t * sync_ts, int32_t * error_ms)
 {
-    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &s_store_read.handle));
-    s_store_read.bank_idx = 0;
-    s_store_read.sample_idx = 0;
-    s_store_read.written_banks = 0;
+    nvs_handle handle;
+    uint64_t tmp;
+    esp_err_t err;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+    err = nvs_get_u64(handle, STO_KEY_DRIFT, &tmp);
+    if (ESP_OK == err)
+    {
+        *drift_ppm = (int32_t) (uint32_t) tmp;
+        *sync_ts = (uint32_t) (tmp >> 32);
+        /* not saved by older firmware */
+        if (ESP_OK != nvs_get_i32(handle, STO_KEY_DRIFT_ERROR, error_ms))
+        {
+            *error_ms = 0;
+        }
+    }
+    nvs_close(handle);
+
+    return (int) err;
+}
+
+int storage_drift_set(int32_t drift_ppm, uint32_t sync_ts, int32_t error_ms)
+{
+    nvs_handle handle;
+    esp_err_t err;
+    uint64_t tmp;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+    tmp = (uint64_t) (uint32_t) drift_ppm;
+    tmp |= ((uint64_t) sync_ts) << 32;
+    err = nvs_set_u64(handle, STO_KEY_DRIFT, tmp);
+    if (ESP_OK == err)
+    {
+        err = nvs_set_i32(handle, STO_KEY_DRIFT_ERROR, error_ms);
+    }
+
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    return (int) err;
+}
+
+int storage_ota_progress_get(OtaProgress_t * progress)
+{
+    nvs_handle handle;
+    size_t len = sizeof(*progress);
+    esp_err_t err;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+    err = nvs_get_blob(handle, STO_KEY_OTA_PROGRESS, progress, &len);
+    nvs_close(handle);
+
+    if ((ESP_OK == err) && (sizeof(*progress) != len))
+    {
+        err = ESP_FAIL;
+    }
+    return (int) err;
+}
+
+int storage_ota_progress_set(const OtaProgress_t * progress)
+{
+    nvs_handle handle;
+    esp_err_t err;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+    if (progress)
+    {
+        err = nvs_set_blob(handle, STO_KEY_OTA_PROGRESS, progress, sizeof(*progress));
+    }
+    else
+    {
+        err = nvs_erase_key(handle, STO_KEY_OTA_PROGRESS);
+    }
+
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    return (int) err;
+}
+
+int storage_ota_stats_get(OtaStats_t * stats)
+{
+    nvs_handle handle;
+    size_t len = sizeof(*stats);
+    esp_err_t err;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+    err = nvs_get_blob(handle, STO_KEY_OTA_STATS, stats, &len);
+    nvs_close(handle);
+
+    if ((ESP_OK == err) && (sizeof(*stats) != len))
+    {
+        err = ESP_FAIL;
+    }
+    return (int) err;
+}
+
+int storage_ota_stats_set(const OtaStats_t * stats)
+{
+    nvs_handle handle;
+    esp_err_t err;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+    if (stats)
+    {
+        err = nvs_set_blob(handle, STO_KEY_OTA_STATS, stats, sizeof(*stats));
+    }
+    else
+    {
+        err = nvs_erase_key(handle, STO_KEY_OTA_STATS);
+    }
+
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    return (int) err;
+}
+
+uint32_t storage_overrun_get(void)
+{
+    nvs_handle handle;
+    uint32_t count = 0;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+    nvs_get_u32(handle, STO_KEY_OVERRUNS, &count);
+    nvs_close(handle);
+
+    return count;
+}
+
+uint32_t storage_overrun_add(void)
+{
+    nvs_handle handle;
+    uint32_t count = 0;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+    nvs_get_u32(handle, STO_KEY_OVERRUNS, &count);
+    ++count;
+    nvs_set_u32(handle, STO_KEY_OVERRUNS, count);
+
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    return count;
+}
+
+static void session_start(StoreSession_t * st)
+{
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &st->handle));
+    st->bank_idx = 0;
+    st->sample_idx = 0;
+    st->written_banks = 0;
 
     int old = -1;
     uint32_t oldts = 0xFFFFFFFF;
@@ -339,70 +761,69 @@ void storage_sample_start(void)
         StorageSample_t sbuf[MEAS_STORAGE_BANK_SIZE];
         char key [] = "mb ";
         size_t sblen = sizeof(sbuf);
-        key[2] = 0x30 + s_store_read.bank_idx;
+        key[2] = 0x30 + st->bank_idx;
 
-        if (ESP_OK == nvs_get_blob(s_store_read.handle, key, sbuf, &sblen))
+        if (ESP_OK == nvs_get_blob(st->handle, key, sbuf, &sblen))
         {
-            ++s_store_read.written_banks;
-            if (sbuf[0].ts < oldts)
+            int si = 0;
+
+            ++st->written_banks;
+
+            /* aggregation extensions do not carry time */
+            while ((si < MEAS_STORAGE_BANK_SIZE - 1) && SAMPLE_IS_EXT(sbuf[si].ts))
+            {
+                ++si;
+            }
+            if (sbuf[si].ts < oldts)
             {
-                oldts = sbuf[0].ts;
+                oldts = sbuf[si].ts;
                 old = bi;
             }
         }
     }
 
-    s_store_read.first_bank = old;
+    st->first_bank = old;
 
 }
 
-int storage_next(StorageSample_t * sample)
+static int session_next(StoreSession_t * st, StorageSample_t * sample)
 {
-    if (s_store_read.first_bank >= 0)
+    if (st->first_bank >= 0)
     {
-        for (; s_store_read.bank_idx < STORAGE_BANK_COUNT; ++s_store_read.bank_idx)
+        for (; st->bank_idx < STORAGE_BANK_COUNT; ++st->bank_idx)
         {
             StorageSample_t sbuf[MEAS_STORAGE_BANK_SIZE];
             char key [] = "mb ";
             size_t sblen = sizeof(sbuf);
-            int bank_idx  = (s_store_read.first_bank + s_store_read.bank_idx) % STORAGE_BANK_COUNT;
+            int bank_idx  = (st->first_bank + st->bank_idx) % STORAGE_BANK_COUNT;
             key[2] = 0x30 + bank_idx;
 
-            if (ESP_OK == nvs_get_blob(s_store_read.handle, key, sbuf, &sblen))
+            if (ESP_OK == nvs_get_blob(st->handle, key, sbuf, &sblen))
             {
-                *sample = sbuf[s_store_read.sample_idx];
-                ++(s_store_read.sample_idx);
-                if (s_store_read.sample_idx >= MEAS_STORAGE_BANK_SIZE)
+                *sample = sbuf[st->sample_idx];
+                ++(st->sample_idx);
+                if (st->sample_idx >= MEAS_STORAGE_BANK_SIZE)
                 {
-                    s_store_read.sample_idx = 0;
-                    ++(s_store_read.bank_idx);
+                    st->sample_idx = 0;
+                    ++(st->bank_idx);
                 }
                 return 0;
             }
         }
     }
-    for (; s_store_read.sample_idx < MEAS_STORAGE_BANK_SIZE; ++s_store_read.sample_idx)
+    for (; st->sample_idx < MEAS_STORAGE_BANK_SIZE; ++st->sample_idx)
     {
 
-        if (0 == read_data_from_rtc(s_store_read.sample_idx, sample))
+        if (0 == read_data_from_rtc(st->sample_idx, sample))
         {
-            ++s_store_read.sample_idx;
+            ++st->sample_idx;
             return 0;
         }
     }
     return -1;
 }
 
-void storage_sample_finish(bool clear_all)
-{
-    if (clear_all)
-    {
-        storage_clear();
-    }
-    nvs_close(s_store_read.handle);
-}
-
-void storage_save_sample(const StorageSample_t * sample)
+static void session_save(StoreSession_t * st, const StorageSample_t * sample)
 {
     if (save_data_in_rtc(sample) < 0)
     {
@@ -410,15 +831,15 @@ void storage_save_sample(const StorageSample_t * sample)
         char key [] = "mb ";
         int bank;
 
-        if (s_store_read.written_banks < STORAGE_BANK_COUNT)
+        if (st->written_banks < STORAGE_BANK_COUNT)
         {
-            bank = s_store_read.written_banks;
-            ++s_store_read.written_banks;
+            bank = st->written_banks;
+            ++st->written_banks;
         }
         else
         {
-            bank = s_store_read.first_bank;
-            s_store_read.first_bank = (s_store_read.first_bank + 1) % STORAGE_BANK_COUNT;
+            bank = st->first_bank;
+            st->first_bank = (st->first_bank + 1) % STORAGE_BANK_COUNT;
         }
 
         key[2] = 0x30 + bank;
@@ -428,22 +849,116 @@ void storage_save_sample(const StorageSample_t * sample)
             read_data_from_rtc(si, &sbuf[si]);
         }
 
-        nvs_set_blob(s_store_read.handle, key, sbuf, sizeof(sbuf));
+        nvs_set_blob(st->handle, key, sbuf, sizeof(sbuf));
 
         clear_rtc_data();
         save_data_in_rtc(sample);
     }
 }
 
-void storage_clear(void)
+static void session_clear(StoreSession_t * st)
 {
     for (int bi = 0; bi < STORAGE_BANK_COUNT; ++bi)
     {
         char key [] = "mb ";
         key[2] = 0x30 + bi;
 
-        nvs_erase_key(s_store_read.handle, key);
+        nvs_erase_key(st->handle, key);
     }
     clear_rtc_data();
 }
 
+void storage_sample_start(void)
+{
+    xSemaphoreTake(s_sample_lock, portMAX_DELAY);
+    session_start(&s_store_read);
+    xSemaphoreGive(s_sample_lock);
+}
+
+int storage_next(StorageSample_t * sample)
+{
+    int r;
+
+    xSemaphoreTake(s_sample_lock, portMAX_DELAY);
+    r = session_next(&s_store_read, sample);
+    xSemaphoreGive(s_sample_lock);
+    return r;
+}
+
+void storage_sample_finish(bool clear_all)
+{
+    xSemaphoreTake(s_sample_lock, portMAX_DELAY);
+    if (clear_all)
+    {
+        session_clear(&s_store_read);
+    }
+    nvs_close(s_store_read.handle);
+    xSemaphoreGive(s_sample_lock);
+}
+
+void storage_save_sample(const StorageSample_t * sample)
+{
+    xSemaphoreTake(s_sample_lock, portMAX_DELAY);
+    session_save(&s_store_read, sample);
+    xSemaphoreGive(s_sample_lock);
+}
+
+void storage_clear(void)
+{
+    xSemaphoreTake(s_sample_lock, portMAX_DELAY);
+    session_clear(&s_store_read);
+    xSemaphoreGive(s_sample_lock);
+}
+
+int storage_save_samples(const StorageSample_t * samples, int count, uint32_t timeout_ms)
+{
+    /* session of main task may be open, use own one */
+    StoreSession_t st;
+
+    if (pdTRUE != xSemaphoreTake(s_sample_lock, timeout_ms / portTICK_PERIOD_MS))
+    {
+        return -1;
+    }
+    session_start(&st);
+    for (int i = 0; i < count; ++i)
+    {
+        session_save(&st, &samples[i]);
+    }
+    nvs_commit(st.handle);
+    nvs_close(st.handle);
+    xSemaphoreGive(s_sample_lock);
+    return 0;
+}
+
+int storage_backlog(void)
+{
+    nvs_handle handle;
+    int count = 0;
+
+    ESP_ERROR_CHECK(nvs_open(STO_NAMESPACE, NVS_READWRITE, &handle));
+
+    for (int bi = 0; bi < STORAGE_BANK_COUNT; ++bi)
+    {
+        char key [] = "mb ";
+        size_t sblen = 0;
+        key[2] = 0x30 + bi;
+
+        if (ESP_OK == nvs_get_blob(handle, key, NULL, &sblen))
+        {
+            count += MEAS_STORAGE_BANK_SIZE;
+        }
+    }
+
+    nvs_close(handle);
+
+    for (int si = 0; si < MEAS_STORAGE_BANK_SIZE; ++si)
+    {
+        StorageSample_t sample;
+        if (0 == read_data_from_rtc(si, &sample))
+        {
+            ++count;
+        }
+    }
+
+    return count;
+}
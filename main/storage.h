@@ -18,6 +18,11 @@
  */
 #define MEAS_STORAGE_BANK_SIZE  60
 
+/**
+ * Value of upload_slot when server did not assign any.
+ */
+#define UPLOAD_SLOT_NONE        0xFFFF
+
 typedef struct
 {
     char server_address [32];
@@ -30,11 +35,55 @@ typedef struct
 
     uint16_t measure_period;
     uint16_t samples_per_measure;
+    uint16_t converge_tol;
+    uint16_t estimator;         /**< See MeasEstimator_t in measurements.h. */
+    uint16_t agg_window;        /**< Measurements aggregated into one record, 0/1 - off. */
+    uint16_t deadband_h;        /**< Skip humidity changes below that [0.1 %RH], 0 with deadband_t 0 - off. */
+    uint16_t deadband_t;        /**< Skip temperature changes below that [0.1 C]. */
+    uint16_t heartbeat;         /**< Report anyway after that [min], 0 - never. */
 
     uint16_t measures_per_sleep;
     uint16_t sleep_length;
+
+    uint16_t wake_budget;
+
+    uint16_t sleep_min;
+    uint16_t sleep_max;
+    uint16_t backlog_target;
+    uint16_t vdd_low;
+
+    uint16_t upload_slot;
+
+    uint16_t current_radio;     /**< Extra current with radio on [0.1mA]. */
+    uint16_t current_cpu;       /**< Current with CPU at 80MHz [0.1mA]. */
+    uint16_t current_cpu_fast;  /**< Current with CPU at 160MHz [0.1mA]. */
+    uint16_t current_sleep;     /**< Current in deep sleep [uA]. */
 } GniotConfig_t;
 
+/**
+ * Encoded measurement carries index of sensor (channel) in
+ * two highest bits, humidity takes less than 14 bits so
+ * measurements of channel 0 are encoded same way as before.
+ */
+#define SAMPLE_CHANNEL_SHIFT    30
+#define SAMPLE_CHANNEL(D)       ((D) >> SAMPLE_CHANNEL_SHIFT)
+#define SAMPLE_VALUE(D)         ((D) & ((1UL << SAMPLE_CHANNEL_SHIFT) - 1))
+#define SAMPLE_WITH_CHANNEL(V, CH)  (SAMPLE_VALUE(V) | (((uint32_t) (CH)) << SAMPLE_CHANNEL_SHIFT))
+
+/**
+ * Sample with timestamp in that range is not a measurement but an
+ * extension of previous measurement of the same channel (aggregated
+ * over a window): kind in bits 16-23, number of measurements
+ * in window in bits 0-15.
+ */
+#define SAMPLE_EXT_FLAG         0xFF000000UL
+#define SAMPLE_EXT_MIN          1   /**< Minimum in window. */
+#define SAMPLE_EXT_MAX          2   /**< Maximum in window. */
+#define SAMPLE_EXT(KIND, COUNT) (SAMPLE_EXT_FLAG | ((uint32_t) (KIND) << 16) | ((COUNT) & 0xFFFF))
+#define SAMPLE_IS_EXT(TS)       (((TS) & SAMPLE_EXT_FLAG) == SAMPLE_EXT_FLAG)
+#define SAMPLE_EXT_KIND(TS)     (((TS) >> 16) & 0xFF)
+#define SAMPLE_EXT_COUNT(TS)    ((TS) & 0xFFFF)
+
 typedef struct
 {
     uint32_t ts;
@@ -53,13 +102,81 @@ int config_switch_server(void);
 int config_set_fallback_server(const char * server_address, uint16_t port);
 int config_set_myid(uint32_t my_id);
 int config_set_measure(uint16_t measure_period, uint16_t samples_per_measure);
+int config_set_converge_tol(uint16_t converge_tol);
+int config_set_estimator(uint16_t estimator);
+int config_set_agg_window(uint16_t agg_window);
+int config_set_deadband(uint16_t deadband_h, uint16_t deadband_t, uint16_t heartbeat);
 int config_set_sleep(uint16_t measures_per_sleep, uint16_t sleep_length);
+int config_set_wake_budget(uint16_t wake_budget);
+int config_set_sched(uint16_t sleep_min, uint16_t sleep_max, uint16_t backlog_target, uint16_t vdd_low);
+int config_set_upload_slot(uint16_t upload_slot);
+int config_set_current_model(uint16_t radio, uint16_t cpu, uint16_t cpu_fast, uint16_t sleep);
+
+uint32_t storage_overrun_get(void);
+uint32_t storage_overrun_add(void);
+
+/**
+ * Read RTC drift model (see rtc.c).
+ * @param drift_ppm output - sleep clock error [ppm]
+ * @param sync_ts output - time of last fit
+ * @param error_ms output - corrections applied since last fit
+ * @return 0 if model was saved before
+ */
+int storage_drift_get(int32_t * drift_ppm, uint32_t * sync_ts, int32_t * error_ms);
+int storage_drift_set(int32_t drift_ppm, uint32_t sync_ts, int32_t error_ms);
+
+/**
+ * State of interrupted firmware download (see ota.c).
+ */
+typedef struct
+{
+    uint32_t image_id;      /**< Image identifier given by server. */
+    uint32_t address;       /**< Partition image is written to. */
+    uint32_t written;       /**< Bytes of image already in flash. */
+    uint32_t crc;           /**< CRC32 of these bytes. */
+} OtaProgress_t;
+
+/**
+ * @return 0 if there is download to resume
+ */
+int storage_ota_progress_get(OtaProgress_t * progress);
+/**
+ * Save download state, NULL clears it.
+ */
+int storage_ota_progress_set(const OtaProgress_t * progress);
+
+/**
+ * Statistics of last firmware download, kept for upload.
+ */
+typedef struct
+{
+    int32_t result;         /**< 0 - image written and verified. */
+    uint32_t received;      /**< Bytes of response body. */
+    uint32_t written;       /**< Bytes of image in flash. */
+    uint32_t time_ms;       /**< Whole download. */
+    uint32_t flash_ms;      /**< Time of flash writes. */
+    uint32_t stall_ms;      /**< Time of waiting for data. */
+} OtaStats_t;
+
+int storage_ota_stats_get(OtaStats_t * stats);
+/**
+ * Save statistics, NULL clears them.
+ */
+int storage_ota_stats_set(const OtaStats_t * stats);
 
 void storage_sample_start(void);
 int storage_next(StorageSample_t * sample);
 void storage_sample_finish(bool clear_all);
 void storage_save_sample(const StorageSample_t * sample);
 void storage_clear(void);
+/**
+ * Save samples in own session, independent of the one opened
+ * by storage_sample_start() (which may be in use by other task).
+ * @param timeout_ms how long to wait for storage in use [ms]
+ * @return 0 on success, -1 if storage stayed busy
+ */
+int storage_save_samples(const StorageSample_t * samples, int count, uint32_t timeout_ms);
+int storage_backlog(void);
 
 
 #endif /* MAIN_STORAGE_H_ */
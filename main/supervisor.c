@@ -0,0 +1,292 @@
+/*
+ * Wake cycle supervisor - hard limit of time spent awake.
+ * supervisor.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include <stdio.h>
+
+#include "supervisor.h"
+#include "storage.h"
+#include "service.h"
+#include "client.h"
+#include "wifi.h"
+#include "rtc.h"
+#include "energy.h"
+#include "record_ring.h"
+#include "debug.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+#include "esp_system.h"
+#include "esp_sleep.h"
+#include "esp_log.h"
+
+/**
+ * How long main task has for saving data and going to sleep
+ * after budget expires [ms].
+ */
+#define SUPERVISOR_GRACE_MS     3000
+/**
+ * How long forced sleep waits for main task to leave its work
+ * on data [ms], and how often it checks [ms].
+ */
+#define SUPERVISOR_WORK_WAIT_MS 2000
+#define SUPERVISOR_WORK_POLL_MS 20
+/**
+ * Task that forces sleep runs above main and measurement tasks.
+ * It saves records with the same storage code main task uses,
+ * so it gets main task stack size, high water mark is logged
+ * on forced sleep to tune it.
+ */
+#define SUPERVISOR_TASK_PRIO    12
+#define SUPERVISOR_TASK_STACK   CONFIG_ESP_MAIN_TASK_STACK_SIZE
+
+static const char * TAG = "supervisor";
+
+static TimerHandle_t s_timer = NULL;
+static TaskHandle_t s_task = NULL;
+static volatile bool s_expired = false;
+static volatile bool s_sleeping = false;
+/**
+ * Main task works on data (between supervisor_work_begin/end).
+ */
+static volatile bool s_working = false;
+/**
+ * Supervisor took data over, main task must not work on it anymore.
+ */
+static volatile bool s_taken = false;
+static uint32_t s_sleep_s = 0;
+/**
+ * Record taken from ring before forced sleep.
+ */
+static MeasRecord_t s_record;
+
+/**
+ * Take data over from main task, when it is not working on it.
+ * @return false if main task did not leave its work in time
+ */
+static bool take_over(void)
+{
+    for (int waited = 0; ; waited += SUPERVISOR_WORK_POLL_MS)
+    {
+        bool taken;
+
+        portENTER_CRITICAL();
+        if (!s_working)
+        {
+            s_taken = true;
+        }
+        taken = s_taken;
+        portEXIT_CRITICAL();
+
+        if (taken || (waited >= SUPERVISOR_WORK_WAIT_MS))
+        {
+            return taken;
+        }
+        vTaskDelay(SUPERVISOR_WORK_POLL_MS / portTICK_PERIOD_MS);
+    }
+}
+
+/**
+ * Save time and enter deep sleep, caller must be first one going to sleep.
+ * @param use_storage false if storage may be in use by hung main task
+ */
+static void enter_sleep(bool use_storage)
+{
+    energy_phase_begin(ENERGY_PH_SLEEP);
+
+    if (s_timer)
+    {
+        xTimerStop(s_timer, 0);
+    }
+
+    if (s_expired)
+    {
+        if (use_storage)
+        {
+            ESP_LOGW(TAG, "wake budget used up (overrun #%u)", storage_overrun_add());
+        }
+        else
+        {
+            ESP_LOGW(TAG, "wake budget used up (overrun not counted)");
+        }
+    }
+
+    // deep sleep - turn everything off except from RTC
+    // requires physical connection of WAKE pin with RST pin!
+    DBG_PRINTF("Going to sleep for %u seconds\n", s_sleep_s);
+    save_timestamp(s_sleep_s);
+    energy_sleep(s_sleep_s);
+    fflush(stdout);
+    esp_deep_sleep(time_sleep_us(s_sleep_s));
+}
+
+/**
+ * First one going to sleep (main task or forced sleep) goes on,
+ * other one is stopped.
+ */
+static void claim_sleep(void)
+{
+    bool sleeping;
+
+    portENTER_CRITICAL();
+    sleeping = s_sleeping;
+    s_sleeping = true;
+    portEXIT_CRITICAL();
+    if (sleeping)
+    {
+        vTaskSuspend(NULL);
+    }
+}
+
+static void emergency_sleep(void)
+{
+    ESP_LOGE(TAG, "main task did not finish, forcing sleep");
+
+    if (take_over())
+    {
+        /* main task will not take records anymore,
+         * supervisor is the consumer of ring now */
+        claim_sleep();
+        while (record_ring_pop(&s_record, 0))
+        {
+            if ((REC_MEASUREMENT == s_record.type) && s_record.count
+                    && storage_save_samples(s_record.samples, s_record.count, SUPERVISOR_WORK_WAIT_MS))
+            {
+                ESP_LOGE(TAG, "storage busy, %d samples lost", s_record.count);
+                rtc_word_set(RTC_WORD_LOST, rtc_word_get(RTC_WORD_LOST) + 1);
+            }
+        }
+        ESP_LOGI(TAG, "stack left %u B", (unsigned) uxTaskGetStackHighWaterMark(NULL));
+        enter_sleep(true);
+    }
+    else
+    {
+        /* main task is stuck with ring and storage, do not touch them;
+         * records waiting in ring are lost (and one main task works
+         * on, if any - not counted) */
+        uint32_t lost = record_ring_count();
+
+        ESP_LOGE(TAG, "main task busy, %u records lost", (unsigned) lost);
+        rtc_word_set(RTC_WORD_LOST, rtc_word_get(RTC_WORD_LOST) + lost);
+        claim_sleep();
+        enter_sleep(false);
+    }
+}
+
+/**
+ * Forces sleep when main task does not go to sleep in grace time.
+ * Storage and deep sleep are not done in timer task (small stack,
+ * must not block other timers).
+ */
+static void supervisor_task(void * arg)
+{
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    emergency_sleep();
+    vTaskDelete(NULL);
+}
+
+static void timer_callback(TimerHandle_t timer)
+{
+    if (!s_expired)
+    {
+        s_expired = true;
+
+        /* cancel anything that blocks main task */
+        wifi_abort();
+        client_abort();
+
+        /* give main task time to finish gracefully */
+        xTimerChangePeriod(timer, SUPERVISOR_GRACE_MS / portTICK_PERIOD_MS, 0);
+    }
+    else if (s_task)
+    {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+void supervisor_start(uint32_t budget_s)
+{
+    s_expired = false;
+    s_working = false;
+    s_taken = false;
+
+    if (0 == s_sleep_s)
+    {
+        s_sleep_s = config_get()->sleep_length * 60;
+    }
+
+    if (budget_s)
+    {
+        if (pdPASS != xTaskCreate(supervisor_task, "supervisor", SUPERVISOR_TASK_STACK, NULL,
+                SUPERVISOR_TASK_PRIO, &s_task))
+        {
+            ESP_LOGE(TAG, "no supervisor task");
+            s_task = NULL;
+        }
+
+        s_timer = xTimerCreate("supervisor", (1000 * budget_s) / portTICK_PERIOD_MS,
+                pdFALSE, NULL, timer_callback);
+        if (s_timer)
+        {
+            xTimerStart(s_timer, 0);
+        }
+    }
+}
+
+bool supervisor_expired(void)
+{
+    return s_expired;
+}
+
+void supervisor_work_begin(void)
+{
+    bool taken;
+
+    portENTER_CRITICAL();
+    taken = s_taken;
+    s_working = !taken;
+    portEXIT_CRITICAL();
+
+    if (taken)
+    {
+        /* supervisor saves data and puts device to sleep */
+        vTaskSuspend(NULL);
+    }
+}
+
+void supervisor_work_end(void)
+{
+    s_working = false;
+}
+
+void supervisor_report(Request_t * request)
+{
+    uint32_t lost = rtc_word_get(RTC_WORD_LOST);
+
+    if (lost)
+    {
+        request_setu(request, "lost", lost);
+    }
+}
+
+void supervisor_report_done(void)
+{
+    rtc_word_set(RTC_WORD_LOST, 0);
+}
+
+void supervisor_set_sleep(uint32_t sleep_s)
+{
+    s_sleep_s = sleep_s;
+}
+
+void supervisor_sleep(void)
+{
+    claim_sleep();
+    enter_sleep(true);
+}
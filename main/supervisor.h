@@ -0,0 +1,68 @@
+/*
+ * Wake cycle supervisor - hard limit of time spent awake.
+ * supervisor.h
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#ifndef MAIN_SUPERVISOR_H_
+#define MAIN_SUPERVISOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "client.h"
+
+/**
+ * Start counting wake time.
+ * When budget expires network work is cancelled and main task
+ * is expected to save data and go to sleep. If it does not do it
+ * in a few seconds, supervisor does it by itself (from own task).
+ * Data is handed over in one direction: supervisor takes it only
+ * when main task is not working on it (see supervisor_work_begin),
+ * and main task never works on it again.
+ * @param budget_s wake budget [s], 0 - no limit
+ */
+void supervisor_start(uint32_t budget_s);
+/**
+ * Check if wake budget is used up.
+ */
+bool supervisor_expired(void);
+/**
+ * Main task starts work on measurement data: taking records
+ * from ring, sending and storing them, going to sleep. Supervisor
+ * does not touch ring nor storage until supervisor_work_end().
+ * If supervisor already took over (forced sleep), calling task
+ * is suspended and this does not return.
+ */
+void supervisor_work_begin(void);
+/**
+ * Main task finished work, records it took are sent or stored.
+ */
+void supervisor_work_end(void);
+/**
+ * Longest text added by supervisor_report [B].
+ */
+#define SUPERVISOR_REPORT_MAX   16
+/**
+ * Append number of records lost by forced sleeps (storage busy,
+ * or main task did not leave its work in time).
+ */
+void supervisor_report(Request_t * request);
+/**
+ * Lost records were reported to server.
+ */
+void supervisor_report_done(void);
+/**
+ * Set sleep length used when going to sleep.
+ * @param sleep_s sleep length [s]
+ */
+void supervisor_set_sleep(uint32_t sleep_s);
+/**
+ * Save time and enter deep sleep. Does not return.
+ * Counts overrun if wake budget was used up.
+ */
+void supervisor_sleep(void);
+
+#endif /* MAIN_SUPERVISOR_H_ */
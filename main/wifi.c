@@ -5,6 +5,8 @@
  *      Author: andrzej
  */
 
+#include <stdbool.h>
+
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -21,6 +23,9 @@
  *  CRED_MY_SSID and CRED_MY_PWD */
 #include "credentials.h"
 
+#include "energy.h"
+#include "debug.h"
+
 #define MAXIMUM_RETRY   8
 
 #define WIFI_CONNECTED_BIT BIT0
@@ -28,7 +33,15 @@
 
 static const char *TAG = "WIFI";
 
+/**
+ * Created once and never deleted, wifi_abort() may use it
+ * from other task at any time.
+ */
 static EventGroupHandle_t s_connect_event_group;
+/**
+ * Wifi is started (between wifi_connect and wifi_disconnect).
+ */
+static bool s_started = false;
 static int s_retry_num = 0;
 static uint32_t s_myip = 0;
 
@@ -82,13 +95,18 @@ int wifi_connect(void)
         },
     };
 
-    if (s_connect_event_group != NULL)
+    if (s_started)
     {
         // already initialized
         return -1;
     }
 
-    s_connect_event_group = xEventGroupCreate();
+    if (s_connect_event_group == NULL)
+    {
+        s_connect_event_group = xEventGroupCreate();
+    }
+    xEventGroupClearBits(s_connect_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT);
+    s_started = true;
     tcpip_adapter_init();
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
@@ -101,6 +119,7 @@ int wifi_connect(void)
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA) );
     ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config) );
+    energy_radio(true);
     ESP_ERROR_CHECK(esp_wifi_start() );
 
     bits = xEventGroupWaitBits(s_connect_event_group,
@@ -136,17 +155,17 @@ const char * wifi_getIpAddress(void)
 int wifi_disconnect(void)
 {
     // not connected yet
-    if (s_connect_event_group == NULL) {
+    if (!s_started) {
         return -1;
     }
 
     ESP_ERROR_CHECK(esp_event_handler_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_handler));
     ESP_ERROR_CHECK(esp_event_handler_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip_handler));
 
-    vEventGroupDelete(s_connect_event_group);
-    s_connect_event_group = NULL;
+    s_started = false;
 
     esp_wifi_stop();
+    energy_radio(false);
     ESP_ERROR_CHECK(esp_wifi_deinit());
 
     ESP_LOGI(TAG, "Disconnected from wifi");
@@ -154,6 +173,30 @@ int wifi_disconnect(void)
 
 }
 
+void wifi_abort(void)
+{
+    EventGroupHandle_t group = s_connect_event_group;
+
+    // stop waiting for connection
+    if (group != NULL)
+    {
+        xEventGroupSetBits(group, WIFI_FAIL_BIT);
+    }
+}
+
+int wifi_rssi(int * rssi)
+{
+    wifi_ap_record_t ap;
+
+    if (s_started && (ESP_OK == esp_wifi_sta_get_ap_info(&ap)))
+    {
+        *rssi = (int) ap.rssi;
+        return 0;
+    }
+
+    return -1;
+}
+
 int wifi_scan(int * rssi)
 {
     int32_t ret;
@@ -171,7 +214,7 @@ int wifi_scan(int * rssi)
 
 
         esp_wifi_scan_get_ap_num(&found_count);
-        printf("Scan found %d stations\n", found_count);
+        DBG_PRINTF("Scan found %d stations\n", found_count);
 
         records = malloc(found_count * sizeof(*records));
 
@@ -187,13 +230,13 @@ int wifi_scan(int * rssi)
 
             for (int i = 0; i < found_count; ++i)
             {
-                printf("%d.\n", i);
-                printf("    BSSID : %02X:%02X:%02X:%02X:%02X:%02X\n", (unsigned) records[i].bssid[0],
+                DBG_PRINTF("%d.\n", i);
+                DBG_PRINTF("    BSSID : %02X:%02X:%02X:%02X:%02X:%02X\n", (unsigned) records[i].bssid[0],
                         (unsigned) records[i].bssid[1], (unsigned) records[i].bssid[2],
                         (unsigned) records[i].bssid[3], (unsigned) records[i].bssid[4],
                         (unsigned) records[i].bssid[5]);
-                printf("    SSID : %s\n", records[i].ssid);
-                printf("    RSSI : %d dB\n", (int) records[i].rssi);
+                DBG_PRINTF("    SSID : %s\n", records[i].ssid);
+                DBG_PRINTF("    RSSI : %d dB\n", (int) records[i].rssi);
                 *rssi = (int) records[i].rssi;
             }
 
@@ -11,6 +11,8 @@
 int wifi_connect(void);
 const char * wifi_getIpAddress(void);
 int wifi_disconnect(void);
+void wifi_abort(void);
+int wifi_rssi(int * rssi);
 
 int wifi_scan(int * rssi);
 
@@ -0,0 +1,308 @@
+/*
+ * Host test of single-wire decoder: replays edge traces captured on device
+ * (humtemp.c built with DHT_TRACE) and synthetic noisy transmissions
+ * through dht_decode, reports success rate and decoding cost.
+ * test_dht_decode.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dht_decode.h"
+
+/**
+ * Trials per synthetic scenario.
+ */
+#define TEST_TRIALS         10000
+/**
+ * Most of edges in one trace.
+ */
+#define TEST_EDGES_MAX      128
+/**
+ * Data bits in transmission.
+ */
+#define TEST_BITS           (8 * DHT_DATA_BYTES)
+
+/**
+ * Faults injected into synthetic sensor transmission.
+ */
+enum {
+    DT_JITTER = 1,      /**< random pulse length variation */
+    DT_MISSING = 2,     /**< one edge not captured */
+    DT_GLITCH = 4,      /**< short spike on the line */
+};
+
+/**
+ * Result of one set of decodings.
+ */
+typedef struct {
+    int ok;
+    int trials;
+    uint64_t cycles;
+    uint64_t ns;
+} Score_t;
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES_NAME         "TSC cycles"
+static inline uint64_t cycles(void)
+{
+    return __rdtsc();
+}
+#else
+#define CYCLES_NAME         "cycles (n/a)"
+static inline uint64_t cycles(void)
+{
+    return 0;
+}
+#endif
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/**
+ * Build edge timeline of transmission of given data,
+ * as gpio_isr_handler would capture it.
+ * @return number of edges
+ */
+static int synth_wave(uint32_t * edges, const uint8_t * data, uint32_t tpu, int faults)
+{
+    uint32_t t = (uint32_t) rand();
+    int n = 0;
+    int jitter = (faults & DT_JITTER) ? 8 : 1;
+
+#define DT_PUSH(LEVEL)      edges[n++] = DHT_EDGE(t, LEVEL)
+
+    /* host releases line, sensor response low+high */
+    DT_PUSH(1);
+    t += (20 + rand() % 20) * tpu;
+    DT_PUSH(0);
+    t += (75 + rand() % jitter) * tpu;
+    DT_PUSH(1);
+    t += (75 + rand() % jitter) * tpu;
+    DT_PUSH(0);
+
+    for (int b = 0; b < TEST_BITS; ++b)
+    {
+        int one = (data[b >> 3] >> (7 - (b & 7))) & 1;
+
+        t += (48 + rand() % jitter) * tpu;
+        DT_PUSH(1);
+        t += ((one ? 68 : 24) + rand() % jitter) * tpu + rand() % tpu;
+        DT_PUSH(0);
+    }
+    t += 50 * tpu;
+    DT_PUSH(1);
+
+#undef DT_PUSH
+
+    if (faults & DT_MISSING)
+    {
+        int k = 5 + rand() % (n - 6);
+
+        memmove(&edges[k], &edges[k + 1], (n - k - 1) * sizeof(edges[0]));
+        --n;
+    }
+
+    if (faults & DT_GLITCH)
+    {
+        int k = 5 + rand() % (n - 6);
+        uint32_t gt = DHT_EDGE_TIME(edges[k]) + (5 + rand() % 10) * tpu;
+        uint32_t level = DHT_EDGE_LEVEL(edges[k]);
+
+        memmove(&edges[k + 3], &edges[k + 1], (n - k - 1) * sizeof(edges[0]));
+        edges[k + 1] = DHT_EDGE(gt, !level);
+        edges[k + 2] = DHT_EDGE(gt + (1 + rand() % 4) * tpu, level);
+        n += 2;
+    }
+
+    return n;
+}
+
+/**
+ * Decode one capture and account it.
+ * @param expected data sent, NULL - unknown (checksum decides)
+ */
+static void score(Score_t * s, const uint32_t * edges, int n, uint32_t tpu, const uint8_t * expected)
+{
+    uint8_t out[DHT_DATA_BYTES];
+    uint64_t start_ns = now_ns();
+    uint64_t start = cycles();
+    int r = dht_decode(edges, n, tpu, out);
+
+    s->cycles += cycles() - start;
+    s->ns += now_ns() - start_ns;
+    ++s->trials;
+
+    if (DHT_DECODE_OK != r)
+    {
+        return;
+    }
+    if (expected ? !memcmp(expected, out, sizeof(out))
+            : ((255 & (out[0] + out[1] + out[2] + out[3])) == out[4]))
+    {
+        ++s->ok;
+    }
+}
+
+static void print_score(const char * name, const Score_t * s)
+{
+    unsigned bits = s->trials ? s->trials * TEST_BITS : 1;
+
+    printf("DT %-26s %5d/%-5d ok (%5.1f%%), %4u %s/bit, %3u ns/bit\n", name, s->ok, s->trials,
+            s->trials ? 100.0 * s->ok / s->trials : 0.0, (unsigned) (s->cycles / bits), CYCLES_NAME,
+            (unsigned) (s->ns / bits));
+}
+
+/**
+ * Synthetic transmissions with random data and faults.
+ * @param trace_file write them there too (NULL - do not)
+ * @return number of scenarios without lost edges that were not all decoded
+ */
+static int synthetic(uint32_t tpu, FILE * trace_file)
+{
+    static const struct {
+        const char * name;
+        int faults;
+    } scenarios[] = {
+        { "clean", 0 },
+        { "jitter", DT_JITTER },
+        { "missing edge", DT_JITTER | DT_MISSING },
+        { "glitch", DT_JITTER | DT_GLITCH },
+        { "missing+glitch", DT_JITTER | DT_MISSING | DT_GLITCH },
+    };
+    uint32_t edges[TEST_EDGES_MAX];
+    int failed = 0;
+
+    for (size_t c = 0; c < sizeof(scenarios) / sizeof(scenarios[0]); ++c)
+    {
+        Score_t s = { 0 };
+        char name[32];
+
+        for (int i = 0; i < TEST_TRIALS; ++i)
+        {
+            uint8_t data[DHT_DATA_BYTES];
+            int n;
+
+            for (int b = 0; b < DHT_DATA_BYTES - 1; ++b)
+            {
+                data[b] = (uint8_t) rand();
+            }
+            data[4] = (uint8_t) (data[0] + data[1] + data[2] + data[3]);
+            n = synth_wave(edges, data, tpu, scenarios[c].faults);
+            score(&s, edges, n, tpu, data);
+
+            if (trace_file && (i < 20))
+            {
+                fprintf(trace_file, "%u", tpu);
+                for (int k = 0; k < n; ++k)
+                {
+                    fprintf(trace_file, " %x", edges[k]);
+                }
+                fprintf(trace_file, "\n");
+            }
+        }
+        snprintf(name, sizeof(name), "%s @%u MHz", scenarios[c].name, tpu);
+        print_score(name, &s);
+        failed += !(scenarios[c].faults & (DT_MISSING | DT_GLITCH)) && (s.ok != s.trials);
+    }
+    return failed;
+}
+
+/**
+ * Replay trace file: one capture per line, "<ticks per us> <edge>...",
+ * edges in hex as DHT_EDGE records. Lines starting with '#' are skipped,
+ * so is "DHT " prefix of console output.
+ * @return 0 if file was read
+ */
+static int replay(const char * name)
+{
+    static char line[16 * TEST_EDGES_MAX];
+    FILE * f = fopen(name, "r");
+    Score_t s = { 0 };
+
+    if (NULL == f)
+    {
+        perror(name);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        uint32_t edges[TEST_EDGES_MAX];
+        char * p = line;
+        char * end;
+        unsigned long tpu;
+        int n = 0;
+
+        if (!strncmp(p, "DHT ", 4))
+        {
+            p += 4;
+        }
+        tpu = strtoul(p, &end, 10);
+        if (('#' == *p) || (end == p) || (0 == tpu))
+        {
+            continue;
+        }
+        for (p = end; n < TEST_EDGES_MAX; ++n)
+        {
+            edges[n] = strtoul(p, &end, 16);
+            if (end == p)
+            {
+                break;
+            }
+            p = end;
+        }
+        score(&s, edges, n, tpu, NULL);
+    }
+    fclose(f);
+
+    print_score(name, &s);
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    FILE * trace_file = NULL;
+    int failed = 0;
+
+    if ((3 == argc) && !strcmp(argv[1], "-w"))
+    {
+        /* write some of synthetic transmissions as trace file */
+        trace_file = fopen(argv[2], "w");
+        if (NULL == trace_file)
+        {
+            perror(argv[2]);
+            return 2;
+        }
+        fprintf(trace_file, "# synthetic, checksum valid\n");
+    }
+
+    if ((1 == argc) || trace_file)
+    {
+        srand(5);
+        failed += synthetic(80, trace_file);
+        failed += synthetic(160, trace_file);
+    }
+    if (trace_file)
+    {
+        fclose(trace_file);
+        return failed != 0;
+    }
+
+    for (int i = 1; i < argc; ++i)
+    {
+        failed += replay(argv[i]);
+    }
+    return failed != 0;
+}
@@ -0,0 +1,340 @@
+/*
+ * Simulated AM2322 behind host I2C driver stub, with simulated clock:
+ * delays and bus transfers only move time forward.
+ * am2322_sim.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "am2322_sim.h"
+#include "humtemp.h"
+
+#include "driver/i2c.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "rom/ets_sys.h"
+
+#define AM_ADDRESS          0x5C
+#define AM_FUNC_READ        0x03
+/**
+ * Sensor wakes up that long after its address [us].
+ */
+#define AM_WAKE_US          800
+/**
+ * Measurement takes that long after read request [us].
+ */
+#define AM_MEASURE_US       1500
+/**
+ * Byte with ACK at 100 kHz [us].
+ */
+#define AM_BYTE_US          90
+#define AM_REGS             0x20
+#define AM_CMD_OPS          8
+
+Am2322Sim_t g_am2322;
+
+static int64_t s_now_us;
+static esp_reset_reason_t s_reason;
+
+/**
+ * Sensor state, register level.
+ */
+static struct {
+    int64_t powered_us;
+    int64_t wake_us;        /**< awake from then on (-1 - asleep) */
+    int64_t ready_us;       /**< response ready from then on */
+    uint8_t request[8];
+    int request_len;
+    uint8_t response[AM_REGS + 4];
+    int response_len;
+} s_sensor;
+
+enum {
+    OP_START,
+    OP_WRITE,
+    OP_READ,
+    OP_STOP,
+};
+
+typedef struct {
+    int type;
+    uint8_t data[16];
+    uint8_t * dst;
+    size_t len;
+    bool ack_check;
+} CmdOp_t;
+
+typedef struct {
+    CmdOp_t ops[AM_CMD_OPS];
+    int count;
+} Cmd_t;
+
+void am2322_sim_reset(esp_reset_reason_t reason)
+{
+    s_now_us = 0;
+    s_reason = reason;
+    memset(&s_sensor, 0, sizeof(s_sensor));
+    /* during deep sleep sensor stays powered */
+    s_sensor.powered_us = (ESP_RST_DEEPSLEEP == reason) ? -60000000LL : 0;
+    s_sensor.wake_us = -1;
+
+    memset(&g_am2322, 0, sizeof(g_am2322));
+    g_am2322.flip_bit = -1;
+    g_am2322.last_measure_us = -60000000LL;
+    /* 52.3 %RH, -1.5 C */
+    g_am2322.humidity = 0x020B;
+    g_am2322.temperature = 0x800F;
+}
+
+esp_reset_reason_t esp_reset_reason(void)
+{
+    return s_reason;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return s_now_us;
+}
+
+void ets_delay_us(uint32_t us)
+{
+    s_now_us += us;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    s_now_us += (int64_t) ticks * portTICK_PERIOD_MS * 1000;
+}
+
+static uint16_t crc16(const uint8_t * data, int len)
+{
+    uint16_t crc = 0xFFFF;
+
+    while (len--)
+    {
+        crc ^= *data++;
+        for (int i = 0; i < 8; ++i)
+        {
+            crc = (crc & 1) ? ((crc >> 1) ^ 0xA001) : (crc >> 1);
+        }
+    }
+    return crc;
+}
+
+static bool sensor_awake(void)
+{
+    return (s_sensor.wake_us >= 0) && (s_now_us >= s_sensor.wake_us);
+}
+
+/**
+ * Address byte on bus.
+ * @return true if acknowledged
+ */
+static bool sensor_address(uint8_t byte)
+{
+    if ((AM_ADDRESS != (byte >> 1)) || (g_am2322.faults & AM_SIM_NO_WAKE))
+    {
+        return false;
+    }
+    if (s_sensor.wake_us < 0)
+    {
+        /* asleep: address only wakes it up */
+        s_sensor.wake_us = s_now_us + AM_WAKE_US;
+        return false;
+    }
+    if (!sensor_awake())
+    {
+        return false;
+    }
+    if (byte & I2C_MASTER_READ)
+    {
+        return !(g_am2322.faults & AM_SIM_READ_NACK) && s_sensor.response_len
+                && (s_now_us >= s_sensor.ready_us);
+    }
+    return true;
+}
+
+/**
+ * Read request complete (stop after written bytes).
+ */
+static void sensor_request(void)
+{
+    uint8_t regs[AM_REGS] = { 0 };
+    const uint8_t * rq = s_sensor.request;
+    uint16_t crc;
+    int n = rq[2];
+
+    s_sensor.response_len = 0;
+    if ((3 != s_sensor.request_len) || (AM_FUNC_READ != rq[0]) || (rq[1] + n > AM_REGS) || (n > 4))
+    {
+        return;
+    }
+
+    if ((s_now_us - s_sensor.powered_us < HT_POWERUP_MS * 1000LL)
+            || (s_now_us - g_am2322.last_measure_us < HT_MIN_INTERVAL_MS * 1000LL))
+    {
+        ++g_am2322.too_early;
+    }
+    g_am2322.last_measure_us = s_now_us;
+    ++g_am2322.measures;
+
+    regs[0] = g_am2322.humidity >> 8;
+    regs[1] = g_am2322.humidity & 0xFF;
+    regs[2] = g_am2322.temperature >> 8;
+    regs[3] = g_am2322.temperature & 0xFF;
+    /* model, version, id */
+    regs[0x08] = 0x23;
+    regs[0x09] = 0x22;
+
+    s_sensor.response[0] = (g_am2322.faults & AM_SIM_FUNCTION) ? (0x80 | AM_FUNC_READ) : AM_FUNC_READ;
+    s_sensor.response[1] = n;
+    memcpy(&s_sensor.response[2], &regs[rq[1]], n);
+    crc = crc16(s_sensor.response, n + 2);
+    s_sensor.response[n + 2] = crc & 0xFF;
+    s_sensor.response[n + 3] = crc >> 8;
+    s_sensor.response_len = n + 4;
+    if ((g_am2322.flip_bit >= 0) && (g_am2322.flip_bit < 8 * s_sensor.response_len))
+    {
+        s_sensor.response[g_am2322.flip_bit >> 3] ^= 0x80 >> (g_am2322.flip_bit & 7);
+    }
+    s_sensor.ready_us = s_now_us + AM_MEASURE_US;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t i2c_num, i2c_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_param_config(i2c_port_t i2c_num, const i2c_config_t * i2c_conf)
+{
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    return calloc(1, sizeof(Cmd_t));
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
+{
+    free(cmd_handle);
+}
+
+static CmdOp_t * cmd_add(i2c_cmd_handle_t cmd_handle, int type)
+{
+    Cmd_t * cmd = cmd_handle;
+    CmdOp_t * op = &cmd->ops[cmd->count++];
+
+    if (cmd->count > AM_CMD_OPS)
+    {
+        abort();
+    }
+    op->type = type;
+    return op;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle)
+{
+    cmd_add(cmd_handle, OP_START);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd_handle, uint8_t * data, size_t data_len, bool ack_en)
+{
+    CmdOp_t * op = cmd_add(cmd_handle, OP_WRITE);
+
+    if (data_len > sizeof(op->data))
+    {
+        abort();
+    }
+    memcpy(op->data, data, data_len);
+    op->len = data_len;
+    op->ack_check = ack_en;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en)
+{
+    return i2c_master_write(cmd_handle, &data, 1, ack_en);
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd_handle, uint8_t * data, size_t data_len, i2c_ack_type_t ack)
+{
+    CmdOp_t * op = cmd_add(cmd_handle, OP_READ);
+
+    op->dst = data;
+    op->len = data_len;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle)
+{
+    cmd_add(cmd_handle, OP_STOP);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle, TickType_t ticks_to_wait)
+{
+    Cmd_t * cmd = cmd_handle;
+    bool addressed = false;
+    bool acked = false;
+    bool reading = false;
+
+    for (int i = 0; i < cmd->count; ++i)
+    {
+        CmdOp_t * op = &cmd->ops[i];
+
+        switch (op->type)
+        {
+        case OP_START:
+            addressed = false;
+            s_sensor.request_len = 0;
+            break;
+        case OP_WRITE:
+            for (size_t k = 0; k < op->len; ++k)
+            {
+                s_now_us += AM_BYTE_US;
+                if (!addressed)
+                {
+                    addressed = true;
+                    reading = op->data[k] & I2C_MASTER_READ;
+                    acked = sensor_address(op->data[k]);
+                }
+                else if (acked && (s_sensor.request_len < sizeof(s_sensor.request)))
+                {
+                    s_sensor.request[s_sensor.request_len++] = op->data[k];
+                }
+                if (!acked && op->ack_check)
+                {
+                    return ESP_FAIL;
+                }
+            }
+            break;
+        case OP_READ:
+            s_now_us += AM_BYTE_US * op->len;
+            for (size_t k = 0; k < op->len; ++k)
+            {
+                /* released bus reads as ones */
+                op->dst[k] = (acked && reading && (k < s_sensor.response_len)) ? s_sensor.response[k] : 0xFF;
+            }
+            break;
+        case OP_STOP:
+            if (acked && !reading)
+            {
+                sensor_request();
+            }
+            else if (acked && reading)
+            {
+                /* sensor goes back to sleep after transaction */
+                s_sensor.wake_us = -1;
+                s_sensor.response_len = 0;
+            }
+            break;
+        }
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,46 @@
+/*
+ * Simulated AM2322 behind host I2C driver stub, with simulated clock.
+ * am2322_sim.h
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#ifndef TEST_AM2322_SIM_H_
+#define TEST_AM2322_SIM_H_
+
+#include <stdint.h>
+
+#include "esp_system.h"
+
+/**
+ * Faults of sensor or bus.
+ */
+enum {
+    AM_SIM_NO_WAKE = 1,     /**< sensor never acknowledges its address */
+    AM_SIM_READ_NACK = 2,   /**< sensor does not acknowledge read */
+    AM_SIM_FUNCTION = 4,    /**< response has wrong function code */
+};
+
+/**
+ * Simulation state visible to test.
+ */
+typedef struct {
+    int faults;
+    int flip_bit;           /**< bit of response inverted (-1 - none) */
+    uint16_t humidity;      /**< register value [0.1 %RH] */
+    uint16_t temperature;   /**< register value, bit 15 - sign [0.1 C] */
+    int64_t last_measure_us;    /**< time of last measurement request */
+    uint32_t measures;      /**< measurement requests served */
+    uint32_t too_early;     /**< addressed before power-up or min. interval */
+} Am2322Sim_t;
+
+extern Am2322Sim_t g_am2322;
+
+/**
+ * Power sensor and restart device at time 0.
+ * @param reason what device wakes from
+ */
+void am2322_sim_reset(esp_reset_reason_t reason);
+
+#endif /* TEST_AM2322_SIM_H_ */
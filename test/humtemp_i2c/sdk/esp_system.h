@@ -0,0 +1,22 @@
+/*
+ * Host stand-in of SDK header, for test/humtemp_i2c.
+ */
+#ifndef TEST_ESP_SYSTEM_H_
+#define TEST_ESP_SYSTEM_H_
+
+#include <stdint.h>
+
+typedef int32_t esp_err_t;
+
+#define ESP_OK      0
+#define ESP_FAIL    -1
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_DEEPSLEEP,
+} esp_reset_reason_t;
+
+esp_reset_reason_t esp_reset_reason(void);
+
+#endif /* TEST_ESP_SYSTEM_H_ */
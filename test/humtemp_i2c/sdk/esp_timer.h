@@ -0,0 +1,12 @@
+/*
+ * Host stand-in of SDK header, for test/humtemp_i2c.
+ * Time is simulated clock (am2322_sim.c).
+ */
+#ifndef TEST_ESP_TIMER_H_
+#define TEST_ESP_TIMER_H_
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+
+#endif /* TEST_ESP_TIMER_H_ */
@@ -0,0 +1,14 @@
+/*
+ * Host stand-in of SDK header, for test/humtemp_i2c.
+ */
+#ifndef TEST_FREERTOS_H_
+#define TEST_FREERTOS_H_
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+
+#define portTICK_PERIOD_MS  10
+#define portTICK_RATE_MS    portTICK_PERIOD_MS
+
+#endif /* TEST_FREERTOS_H_ */
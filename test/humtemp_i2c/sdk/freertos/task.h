@@ -0,0 +1,12 @@
+/*
+ * Host stand-in of SDK header, for test/humtemp_i2c.
+ * Delay only moves simulated clock (am2322_sim.c).
+ */
+#ifndef TEST_TASK_H_
+#define TEST_TASK_H_
+
+#include "freertos/FreeRTOS.h"
+
+void vTaskDelay(TickType_t ticks);
+
+#endif /* TEST_TASK_H_ */
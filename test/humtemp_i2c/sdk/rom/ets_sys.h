@@ -0,0 +1,12 @@
+/*
+ * Host stand-in of SDK header, for test/humtemp_i2c.
+ * Delay only moves simulated clock (am2322_sim.c).
+ */
+#ifndef TEST_ETS_SYS_H_
+#define TEST_ETS_SYS_H_
+
+#include <stdint.h>
+
+void ets_delay_us(uint32_t us);
+
+#endif /* TEST_ETS_SYS_H_ */
@@ -0,0 +1,172 @@
+/*
+ * Host test of AM2322 driver (humtemp_i2c.c): humtemp_read runs against
+ * simulated sensor behind I2C driver stub, including corrupted responses
+ * and sensor not answering.
+ * test_humtemp_i2c.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "humtemp.h"
+#include "am2322_sim.h"
+#include "esp_timer.h"
+
+/**
+ * Readings of random values.
+ */
+#define TEST_VALUES         1000
+/**
+ * Bits of response to read of 4 registers.
+ */
+#define TEST_RESPONSE_BITS  (8 * 8)
+
+static int s_failed;
+
+#define CHECK(COND, ...)    do { if (!(COND)) { printf("I2C FAIL " __VA_ARGS__); printf("\n"); ++s_failed; } } while (0)
+
+/**
+ * Read sensor, check result code and statistics.
+ * @return result of humtemp_read
+ */
+static int read_expect(const char * name, int expected, Humidity_t * h, Temperature_t * t)
+{
+    HumTempStats_t before, after;
+    int r;
+
+    humtemp_stats(0, &before);
+    r = humtemp_read(0, h, t);
+    humtemp_stats(0, &after);
+
+    CHECK(r == expected, "%s: result %d, expected %d", name, r, expected);
+    CHECK(after.reads == before.reads + 1, "%s: reads not counted", name);
+    CHECK((after.ok - before.ok) == (HT_SUCCESS == expected), "%s: ok count", name);
+    CHECK((after.checksum_errors - before.checksum_errors) == (HT_E_CHECKSUM == expected),
+            "%s: checksum error count", name);
+    CHECK((after.timeouts - before.timeouts) == (HT_E_TIMEOUT == expected), "%s: timeout count", name);
+    return r;
+}
+
+static void test_boot(void)
+{
+    Humidity_t h = 0;
+    Temperature_t t = 0;
+
+    /* cold boot: first read waits for sensor power-up */
+    am2322_sim_reset(ESP_RST_POWERON);
+    humtemp_init();
+    read_expect("cold boot", HT_SUCCESS, &h, &t);
+    CHECK((523 == h) && (-15 == (int16_t) t), "cold boot: %u %d", h, (int16_t) t);
+    CHECK(esp_timer_get_time() >= HT_POWERUP_MS * 1000LL, "cold boot: read before power-up");
+
+    /* next read waits for minimal interval */
+    read_expect("second read", HT_SUCCESS, &h, &t);
+    CHECK(0 == g_am2322.too_early, "sensor read %u times too early", g_am2322.too_early);
+
+    /* after deep sleep sensor is ready at once */
+    am2322_sim_reset(ESP_RST_DEEPSLEEP);
+    humtemp_init();
+    read_expect("deep sleep wake", HT_SUCCESS, &h, &t);
+    CHECK(esp_timer_get_time() < 10000, "deep sleep wake: read took %lld us",
+            (long long) esp_timer_get_time());
+    CHECK(0 == g_am2322.too_early, "sensor read %u times too early", g_am2322.too_early);
+
+    printf("I2C boot: cold %u ms, deep sleep wake %u us\n", HT_POWERUP_MS, (unsigned) esp_timer_get_time());
+}
+
+static void test_values(void)
+{
+    am2322_sim_reset(ESP_RST_DEEPSLEEP);
+    humtemp_init();
+
+    for (int i = 0; i < TEST_VALUES; ++i)
+    {
+        uint16_t rh = rand() % 1001;
+        int16_t temp = rand() % 1201 - 400;
+        Humidity_t h;
+        Temperature_t t;
+
+        g_am2322.humidity = rh;
+        g_am2322.temperature = (temp < 0) ? (0x8000 | -temp) : temp;
+        if (HT_SUCCESS == read_expect("values", HT_SUCCESS, &h, &t))
+        {
+            CHECK((rh == h) && (temp == (int16_t) t), "values: %u %d read as %u %d", rh, temp, h, (int16_t) t);
+        }
+    }
+    CHECK(0 == g_am2322.too_early, "sensor read %u times too early", g_am2322.too_early);
+    printf("I2C %d random values read\n", TEST_VALUES);
+}
+
+/**
+ * Every single bit error of response must be caught: in function code
+ * or length as unexpected response, elsewhere by CRC.
+ */
+static void test_corruption(void)
+{
+    am2322_sim_reset(ESP_RST_DEEPSLEEP);
+    humtemp_init();
+
+    for (int bit = 0; bit < TEST_RESPONSE_BITS; ++bit)
+    {
+        Humidity_t h = 0x5A5A;
+        Temperature_t t = 0x5A5A;
+        char name[32];
+
+        snprintf(name, sizeof(name), "bit %d flipped", bit);
+        g_am2322.flip_bit = bit;
+        read_expect(name, (bit < 16) ? HT_E_UNKNOWN : HT_E_CHECKSUM, &h, &t);
+        CHECK((0x5A5A == h) && (0x5A5A == t), "%s: output changed", name);
+    }
+    g_am2322.flip_bit = -1;
+    printf("I2C %d corrupted responses rejected\n", TEST_RESPONSE_BITS);
+}
+
+static void test_faults(void)
+{
+    static const struct {
+        const char * name;
+        int faults;
+        int expected;
+    } cases[] = {
+        { "no wake", AM_SIM_NO_WAKE, HT_E_TIMEOUT },
+        { "read not acknowledged", AM_SIM_READ_NACK, HT_E_TIMEOUT },
+        { "wrong function code", AM_SIM_FUNCTION, HT_E_UNKNOWN },
+    };
+    Humidity_t h;
+    Temperature_t t;
+
+    am2322_sim_reset(ESP_RST_DEEPSLEEP);
+    humtemp_init();
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c)
+    {
+        g_am2322.faults = cases[c].faults;
+        read_expect(cases[c].name, cases[c].expected, &h, &t);
+        g_am2322.faults = 0;
+        /* sensor that recovered is read again */
+        read_expect(cases[c].name, HT_SUCCESS, &h, &t);
+    }
+
+    CHECK(HT_E_UNKNOWN == humtemp_read(1, &h, &t), "channel 1 accepted");
+    printf("I2C %d bus faults handled\n", (int) (sizeof(cases) / sizeof(cases[0])));
+}
+
+int main(void)
+{
+    srand(3);
+
+    test_boot();
+    test_values();
+    test_corruption();
+    test_faults();
+
+    if (s_failed)
+    {
+        printf("I2C %d checks failed\n", s_failed);
+    }
+    return s_failed != 0;
+}
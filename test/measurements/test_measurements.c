@@ -0,0 +1,220 @@
+/*
+ * Host test of sample filtering (measurements.c): checks median against
+ * sorted samples and accuracy of streaming P-square median, reports cost
+ * of adding samples and of measurement_get for 3..255 samples.
+ * test_measurements.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "measurements.h"
+#include "rtc.h"
+
+/**
+ * Measurements per benchmark point.
+ */
+#define TEST_RUNS           2000
+/**
+ * Most samples per measurement.
+ */
+#define TEST_SAMPLES_MAX    255
+/**
+ * Largest error of P-square median allowed, in units of
+ * measurements.c (10 per DHT_fixedpoint unit): 2 %RH,
+ * accuracy of sensor itself.
+ */
+#define TEST_P2_ERROR_MAX   200
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES_NAME         "TSC cycles"
+static inline uint64_t cycles(void)
+{
+    return __rdtsc();
+}
+#else
+#define CYCLES_NAME         "cycles (n/a)"
+static inline uint64_t cycles(void)
+{
+    return 0;
+}
+#endif
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/* RTC memory of device, used by deadband only */
+static uint32_t s_rtc[RTC_WORD_COUNT];
+
+uint32_t rtc_word_get(RtcWord_t word)
+{
+    return s_rtc[word];
+}
+
+void rtc_word_set(RtcWord_t word, uint32_t value)
+{
+    s_rtc[word] = value;
+}
+
+/**
+ * Cost and accuracy of one benchmark point.
+ */
+typedef struct {
+    uint64_t add_ns;        /**< all measurement_add_sample calls */
+    uint64_t switch_ns;     /**< add of sample that moves array to P-square */
+    uint64_t get_ns;
+    uint64_t get_cycles;
+    uint64_t error_sum;     /**< distance of humidity from median of samples */
+    int error_max;
+    int mismatch;           /**< median differs from sorted samples */
+} Result_t;
+
+static int compare(const void * a, const void * b)
+{
+    return *(const int16_t *) a - *(const int16_t *) b;
+}
+
+/**
+ * Noisy samples, around 50 %RH / 21 C with occasional outlier
+ * (same as sensor on device gives).
+ */
+static void samples(Humidity_t * h, Temperature_t * t, int n)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        h[i] = 500 + rand() % 20 - ((rand() % 16) ? 0 : 300);
+        t[i] = 210 + rand() % 10 - 5;
+    }
+}
+
+static void run(Result_t * r, int n)
+{
+    Humidity_t h[TEST_SAMPLES_MAX];
+    Temperature_t t[TEST_SAMPLES_MAX];
+    int16_t sorted_h[TEST_SAMPLES_MAX];
+    int16_t sorted_t[TEST_SAMPLES_MAX];
+    uint64_t start_ns, start;
+    uint32_t meas;
+    int16_t mh, mt;
+    int error;
+
+    samples(h, t, n);
+
+    start_ns = now_ns();
+    for (int i = 0; i < n; ++i)
+    {
+        if (MEAS_MAX_SAMPLES == i)
+        {
+            /* this one replays whole array into P-square estimators */
+            r->add_ns += now_ns() - start_ns;
+            start_ns = now_ns();
+            measurement_add_sample(0, h[i], t[i]);
+            r->switch_ns += now_ns() - start_ns;
+            start_ns = now_ns();
+            continue;
+        }
+        measurement_add_sample(0, h[i], t[i]);
+    }
+    r->add_ns += now_ns() - start_ns;
+
+    start_ns = now_ns();
+    start = cycles();
+    measurement_get(0, &meas);
+    r->get_cycles += cycles() - start;
+    r->get_ns += now_ns() - start_ns;
+
+    for (int i = 0; i < n; ++i)
+    {
+        sorted_h[i] = (int16_t) (h[i] * 10);
+        sorted_t[i] = (int16_t) (t[i] * 10);
+    }
+    qsort(sorted_h, n, sizeof(sorted_h[0]), compare);
+    qsort(sorted_t, n, sizeof(sorted_t[0]), compare);
+
+    mh = (int16_t) (SAMPLE_VALUE(meas) >> 16);
+    mt = (int16_t) (meas & 0xFFFF);
+    error = abs(mh - sorted_h[n / 2]);
+    r->error_sum += error;
+    if (error > r->error_max)
+    {
+        r->error_max = error;
+    }
+    if ((n <= MEAS_MAX_SAMPLES) && ((mh != sorted_h[n / 2]) || (mt != sorted_t[n / 2])))
+    {
+        ++r->mismatch;
+    }
+}
+
+int main(void)
+{
+    static const char * names[MEAS_EST_COUNT] = { "median", "trimmed", "mad" };
+    static const int sizes[] = { 3, 5, 7, 9, 15, 31, 32, 33, 63, 127, 255 };
+    GniotConfig_t cfg;
+    int failed = 0;
+
+    memset(&cfg, 0, sizeof(cfg));
+    srand(7);
+
+    printf("MB %d samples kept, above that every estimator is streaming P-square median\n", MEAS_MAX_SAMPLES);
+    printf("MB   n estimator      add ns/sample  switch ns  get ns  get %-10s  |h - median| mean/max\n", CYCLES_NAME);
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+    {
+        int n = sizes[s];
+
+        for (int e = 0; e < MEAS_EST_COUNT; ++e)
+        {
+            Result_t r = { 0 };
+            bool streaming = n > MEAS_MAX_SAMPLES;
+            char sw[12] = "-";
+
+            cfg.samples_per_measure = n;
+            cfg.estimator = e;
+            measurement_init(&cfg);
+
+            for (int i = 0; i < TEST_RUNS; ++i)
+            {
+                run(&r, n);
+            }
+
+            if (streaming)
+            {
+                snprintf(sw, sizeof(sw), "%u", (unsigned) (r.switch_ns / TEST_RUNS));
+            }
+            printf("MB %3d %-14s %13.1f  %9s  %6u  %14u  %5.1f/%d\n", n,
+                    streaming ? "P-square (any)" : names[e],
+                    (double) r.add_ns / ((uint64_t) TEST_RUNS * n), sw,
+                    (unsigned) (r.get_ns / TEST_RUNS), (unsigned) (r.get_cycles / TEST_RUNS),
+                    (double) r.error_sum / TEST_RUNS, r.error_max);
+
+            if ((MEAS_EST_MEDIAN == e) && r.mismatch)
+            {
+                printf("MB %3d median differs from sorted samples %d times\n", n, r.mismatch);
+                ++failed;
+            }
+            if (streaming && (r.error_max > TEST_P2_ERROR_MAX))
+            {
+                printf("MB %3d P-square error %d above %d\n", n, r.error_max, TEST_P2_ERROR_MAX);
+                ++failed;
+            }
+            if (streaming)
+            {
+                /* estimator does not matter, one row is enough */
+                break;
+            }
+        }
+    }
+
+    return failed != 0;
+}
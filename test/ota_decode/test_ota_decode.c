@@ -0,0 +1,336 @@
+/*
+ * Host round-trip test of OTA image decoders: images encoded by
+ * tools/ota_delta.py are decoded in randomly cut pieces and compared
+ * byte by byte with the new image.
+ * test_ota_decode.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ota_decode.h"
+
+/**
+ * Size of generated running image [B].
+ */
+#define TEST_IMAGE_SIZE     (192 * 1024)
+/**
+ * Longest read of client, decoders get at most that at once.
+ */
+#define TEST_READ_MAX       1023
+/**
+ * Random cuttings of each encoded image.
+ */
+#define TEST_RUNS           20
+
+typedef struct {
+    const uint8_t * base;
+    size_t base_size;
+    uint8_t * out;
+    size_t out_size;
+    size_t written;
+    LzssDecoder_t lzss;
+    DeltaDecoder_t delta;
+    int delta_on;
+} Target_t;
+
+static uint8_t * read_file(const char * name, size_t * size)
+{
+    FILE * f = fopen(name, "rb");
+    uint8_t * data;
+    long n;
+
+    if (NULL == f)
+    {
+        perror(name);
+        exit(2);
+    }
+    fseek(f, 0, SEEK_END);
+    n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(n ? n : 1);
+    if ((NULL == data) || (fread(data, 1, n, f) != (size_t) n))
+    {
+        perror(name);
+        exit(2);
+    }
+    fclose(f);
+    *size = n;
+    return data;
+}
+
+static void write_file(const char * name, const uint8_t * data, size_t size)
+{
+    FILE * f = fopen(name, "wb");
+
+    if ((NULL == f) || (fwrite(data, 1, size, f) != size))
+    {
+        perror(name);
+        exit(2);
+    }
+    fclose(f);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/**
+ * Running image of code-like content (repeated instruction words)
+ * and its next version: few patches, insertions and removals,
+ * so that later code moves like in relinked firmware.
+ */
+static void generate(const char * base_name, const char * new_name)
+{
+    static uint8_t words[256][8];
+    uint8_t * base = malloc(TEST_IMAGE_SIZE);
+    uint8_t * new = malloc(2 * TEST_IMAGE_SIZE);
+    size_t n = 0;
+    size_t pos = 0;
+
+    srand(1);
+    for (int w = 0; w < 256; ++w)
+    {
+        for (int k = 0; k < 8; ++k)
+        {
+            words[w][k] = rand();
+        }
+    }
+    base[n++] = 0xE9;
+    while (n < TEST_IMAGE_SIZE)
+    {
+        size_t len = 2 + rand() % 7;
+
+        if (len > TEST_IMAGE_SIZE - n)
+        {
+            len = TEST_IMAGE_SIZE - n;
+        }
+        memcpy(&base[n], words[rand() % 256], len);
+        n += len;
+    }
+
+    n = 0;
+    while (pos < TEST_IMAGE_SIZE)
+    {
+        size_t keep = 500 + rand() % 6000;
+
+        if (keep > TEST_IMAGE_SIZE - pos)
+        {
+            keep = TEST_IMAGE_SIZE - pos;
+        }
+        memcpy(&new[n], &base[pos], keep);
+        n += keep;
+        pos += keep;
+
+        switch (rand() % 3)
+        {
+        case 0:
+            /* patched bytes */
+            for (int k = rand() % 40; k >= 0; --k)
+            {
+                new[n++] = rand();
+            }
+            pos += rand() % 40;
+            break;
+        case 1:
+            /* inserted code */
+            for (int k = rand() % 200; k >= 0; --k)
+            {
+                new[n++] = words[rand() % 256][k % 8];
+            }
+            break;
+        default:
+            /* removed code */
+            pos += rand() % 200;
+            break;
+        }
+    }
+
+    write_file(base_name, base, TEST_IMAGE_SIZE);
+    write_file(new_name, new, n);
+    printf("generated %s %d B, %s %u B\n", base_name, TEST_IMAGE_SIZE, new_name, (unsigned) n);
+    free(base);
+    free(new);
+}
+
+static int target_out(void * ctx, const uint8_t * data, size_t size)
+{
+    Target_t * t = ctx;
+
+    if (size > t->out_size - t->written)
+    {
+        return 1;
+    }
+    memcpy(&t->out[t->written], data, size);
+    t->written += size;
+    return 0;
+}
+
+static int target_copy(void * ctx, uint32_t offset, uint32_t size)
+{
+    Target_t * t = ctx;
+
+    if ((offset > t->base_size) || (size > t->base_size - offset))
+    {
+        return 1;
+    }
+    return target_out(ctx, &t->base[offset], size);
+}
+
+static int decompressed_out(void * ctx, const uint8_t * data, size_t size)
+{
+    Target_t * t = ctx;
+
+    if (t->delta_on)
+    {
+        return delta_decode(&t->delta, data, size, target_out, target_copy, ctx);
+    }
+    return target_out(ctx, data, size);
+}
+
+/**
+ * Decode body in pieces of random size up to max_read (fixed max_read if
+ * random is 0), the way ota.c does.
+ * @return decoder result
+ */
+static int decode(Target_t * t, const uint8_t * body, size_t size, int lzss, size_t max_read, int random)
+{
+    size_t pos = 0;
+    int r = OTA_DECODE_OK;
+
+    t->written = 0;
+    lzss_init(&t->lzss);
+    delta_init(&t->delta);
+
+    while ((pos < size) && (OTA_DECODE_OK == r))
+    {
+        size_t n = random ? 1 + rand() % max_read : max_read;
+
+        if (n > size - pos)
+        {
+            n = size - pos;
+        }
+        if (lzss)
+        {
+            r = lzss_decode(&t->lzss, &body[pos], n, decompressed_out, t);
+        }
+        else
+        {
+            r = delta_decode(&t->delta, &body[pos], n, target_out, target_copy, t);
+        }
+        pos += n;
+    }
+    return r;
+}
+
+/**
+ * Check one encoded image.
+ * @param spec <file>:<encoding>, encoding as in X-Ota-Encoding
+ * @return number of failed runs
+ */
+static int check(const uint8_t * base, size_t base_size, const uint8_t * new, size_t new_size,
+        const char * spec, unsigned rate)
+{
+    static const size_t reads[] = { 1, 3, 16, TEST_READ_MAX };
+    char name[256];
+    const char * encoding = strchr(spec, ':');
+    size_t size;
+    uint8_t * body;
+    Target_t t;
+    int lzss;
+    int failed = 0;
+    uint64_t start;
+    uint64_t decode_ns = 0;
+
+    snprintf(name, sizeof(name), "%.*s", (int) (encoding ? encoding - spec : strlen(spec)), spec);
+    encoding = encoding ? encoding + 1 : "";
+    body = read_file(name, &size);
+
+    memset(&t, 0, sizeof(t));
+    t.base = base;
+    t.base_size = base_size;
+    t.out_size = new_size + 1;
+    t.out = malloc(t.out_size);
+    lzss = NULL != strstr(encoding, "lzss");
+    t.delta_on = NULL != strstr(encoding, "delta");
+
+    if (!lzss && !t.delta_on)
+    {
+        /* raw image goes to flash as it comes */
+        failed += (size != new_size) || memcmp(body, new, new_size);
+    }
+    else
+    {
+        for (int run = 0; run < TEST_RUNS + (int) (sizeof(reads) / sizeof(reads[0])); ++run)
+        {
+            int fixed = run < (int) (sizeof(reads) / sizeof(reads[0]));
+            int r;
+
+            start = now_ns();
+            r = decode(&t, body, size, lzss, fixed ? reads[run] : (run & 1 ? 16 : TEST_READ_MAX), !fixed);
+            if (fixed && (TEST_READ_MAX == reads[run]))
+            {
+                decode_ns = now_ns() - start;
+            }
+            if ((OTA_DECODE_OK != r) || (t.written != new_size) || memcmp(t.out, new, new_size))
+            {
+                printf("  %s run %d: result %d, %u of %u B\n", name, run, r, (unsigned) t.written,
+                        (unsigned) new_size);
+                ++failed;
+            }
+        }
+    }
+
+    /* update time = download at assumed rate + decoding (host cost, target is slower) */
+    printf("%-16s %-11s %7u B (%3u%%) %s, decode %4u ns/KB, download @ %u B/s %6u ms\n", name,
+            *encoding ? encoding : "raw", (unsigned) size, (unsigned) (100 * size / new_size),
+            failed ? "FAIL" : "OK  ", (unsigned) (decode_ns * 1024 / new_size), rate,
+            (unsigned) ((uint64_t) size * 1000 / rate));
+
+    free(t.out);
+    free(body);
+    return failed;
+}
+
+int main(int argc, char ** argv)
+{
+    size_t base_size;
+    size_t new_size;
+    uint8_t * base;
+    uint8_t * new;
+    int failed = 0;
+
+    if ((4 == argc) && !strcmp(argv[1], "gen"))
+    {
+        generate(argv[2], argv[3]);
+        return 0;
+    }
+    if ((argc < 6) || strcmp(argv[1], "check"))
+    {
+        printf("usage: %s gen <base.bin> <new.bin>\n"
+                "       %s check <base.bin> <new.bin> <rate B/s> <file>:<encoding>...\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    base = read_file(argv[2], &base_size);
+    new = read_file(argv[3], &new_size);
+    srand(2);
+    for (int i = 5; i < argc; ++i)
+    {
+        failed += check(base, base_size, new, new_size, argv[i], (unsigned) atoi(argv[4]));
+    }
+    printf("%d runs failed\n", failed);
+
+    free(base);
+    free(new);
+    return failed != 0;
+}
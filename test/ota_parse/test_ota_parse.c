@@ -0,0 +1,482 @@
+/*
+ * Host test of OTA response parser and sector staging: responses of every
+ * kind are cut at each point of header and randomly, image that comes out
+ * is staged into sectors of fake partition and compared byte by byte.
+ * test_ota_parse.c
+ *
+ *  Created on: 18 paz 2026
+ *      Author: agent
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ota_parse.h"
+#include "ota_sector.h"
+#include "ota_decode.h"
+
+/**
+ * Size of each slot image [B].
+ */
+#define TEST_IMAGE_SIZE     (128 * 1024)
+/**
+ * Longest read of client.
+ */
+#define TEST_READ_MAX       1023
+/**
+ * Random cuttings of each response, for each of s_max_reads.
+ */
+#define TEST_RUNS           10
+/**
+ * Part of image in flash before resumed download (one checkpoint).
+ */
+#define TEST_RESUME_AT      (16 * 4096)
+/**
+ * Slot being written (running image is in slot 0).
+ */
+#define TEST_SLOT           1
+
+typedef enum {
+    BODY_DUAL,              /**< Both images, ours second. */
+    BODY_SINGLE,            /**< Our image. */
+    BODY_RESUME,            /**< Our image from TEST_RESUME_AT. */
+    BODY_FILE,              /**< Encoded image from file. */
+} Body_t;
+
+typedef struct {
+    const char * name;
+    Body_t body;
+    const char * headers;   /**< Extra header lines, %u - TEST_SLOT. */
+    const char * file;      /**< Encoded image (BODY_FILE). */
+    bool fails;             /**< Response must be rejected. */
+} Case_t;
+
+static const Case_t s_cases[] = {
+    { "dual", BODY_DUAL, "" },
+    { "single", BODY_SINGLE, "X-Ota-Slot: %u\r\nX-Ota-Image: 7\r\nX-Ota-Crc32: 1234abcd\r\n" },
+    { "single lower", BODY_SINGLE, "x-ota-slot:%u\r\ncontent-type: application/octet-stream\r\n" },
+    { "resume 206", BODY_RESUME, "X-Ota-Slot: %u\r\nX-Ota-Image: 7\r\n" },
+    { "lzss", BODY_FILE, "X-Ota-Slot: %u\r\nX-Ota-Encoding: lzss\r\n", "lzss.bin" },
+    { "delta", BODY_FILE, "X-Ota-Slot: %u\r\nX-Ota-Encoding: delta\r\n", "delta.bin" },
+    { "delta,lzss", BODY_FILE, "X-Ota-Slot: %u\r\nX-Ota-Encoding: delta,lzss\r\n", "delta-lzss.bin" },
+    { "wrong slot", BODY_SINGLE, "X-Ota-Slot: 0\r\n", NULL, true },
+    { "dual encoded", BODY_DUAL, "X-Ota-Encoding: lzss\r\n", NULL, true },
+    { "bad encoding", BODY_FILE, "X-Ota-Slot: %u\r\nX-Ota-Encoding: gzip\r\n", "lzss.bin", true },
+};
+
+static const uint16_t s_max_reads[] = { TEST_READ_MAX, 16, 3 };
+
+static uint8_t * s_running;
+static uint8_t * s_image;
+static size_t s_image_size;
+static uint8_t s_partition[2 * TEST_IMAGE_SIZE];
+static char s_response[4 * TEST_IMAGE_SIZE];
+
+/**
+ * Consumer of image data, like ota.c: decoders, staging and fake flash.
+ */
+static struct {
+    size_t offset;          /**< Next flash write. */
+    bool started;
+    bool error;
+    uint8_t encoding;
+    LzssDecoder_t lzss;
+    DeltaDecoder_t delta;
+    OtaSector_t sector;
+    char buffer[OTA_SECTOR_SIZE];
+    size_t written;
+    unsigned writes;
+    unsigned partial;       /**< Writes of less than sector. */
+} s_sink;
+
+static esp_ota_firm_t s_ota_firm;
+/**
+ * Time in parser, in whole response handler and in fake flash.
+ */
+static uint64_t s_parse_ns;
+static uint64_t s_handler_ns;
+static uint64_t s_flash_ns;
+
+static uint8_t * read_file(const char * name, size_t * size)
+{
+    FILE * f = fopen(name, "rb");
+    uint8_t * data;
+    long n;
+
+    if (NULL == f)
+    {
+        perror(name);
+        exit(2);
+    }
+    fseek(f, 0, SEEK_END);
+    n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(n ? n : 1);
+    if ((NULL == data) || (fread(data, 1, n, f) != (size_t) n))
+    {
+        perror(name);
+        exit(2);
+    }
+    fclose(f);
+    *size = n;
+    return data;
+}
+
+static void write_file(const char * name, const uint8_t * data, size_t size)
+{
+    FILE * f = fopen(name, "wb");
+
+    if ((NULL == f) || (fwrite(data, 1, size, f) != size))
+    {
+        perror(name);
+        exit(2);
+    }
+    fclose(f);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/**
+ * Running image (slot 0) and new one (slot 1) - the same code words,
+ * new one patched in few places.
+ */
+static void generate(const char * running_name, const char * new_name)
+{
+    static uint8_t words[64][4];
+    uint8_t * running = malloc(TEST_IMAGE_SIZE);
+    uint8_t * new = malloc(TEST_IMAGE_SIZE);
+
+    srand(3);
+    for (int w = 0; w < 64; ++w)
+    {
+        for (int k = 0; k < 4; ++k)
+        {
+            words[w][k] = rand();
+        }
+    }
+    for (size_t i = 0; i < TEST_IMAGE_SIZE; i += 4)
+    {
+        memcpy(&running[i], words[rand() % 64], 4);
+    }
+    memcpy(new, running, TEST_IMAGE_SIZE);
+    for (int p = 0; p < 30; ++p)
+    {
+        size_t at = rand() % (TEST_IMAGE_SIZE - 64);
+
+        for (int k = rand() % 64; k >= 0; --k)
+        {
+            new[at + k] = rand();
+        }
+    }
+
+    write_file(running_name, running, TEST_IMAGE_SIZE);
+    write_file(new_name, new, TEST_IMAGE_SIZE);
+    free(running);
+    free(new);
+}
+
+/**
+ * Fake partition, takes writes from sector start only, like partition_write of ota.c.
+ */
+static int partition_flash(void * ctx, const void * data, size_t size)
+{
+    uint64_t start = now_ns();
+
+    if ((s_sink.offset % OTA_SECTOR_SIZE) || (size > OTA_SECTOR_SIZE)
+            || (size > sizeof(s_partition) - s_sink.offset))
+    {
+        return 1;
+    }
+    memcpy(&s_partition[s_sink.offset], data, size);
+    s_sink.offset += size;
+    s_sink.written += size;
+    ++s_sink.writes;
+    s_sink.partial += (OTA_SECTOR_SIZE != size);
+    s_flash_ns += now_ns() - start;
+    return 0;
+}
+
+static int running_read(void * ctx, uint32_t offset, void * data, size_t size)
+{
+    memcpy(data, &s_running[offset], size);
+    return 0;
+}
+
+static int sink_out(void * ctx, const uint8_t * data, size_t size)
+{
+    return ota_sector_write(&s_sink.sector, data, size);
+}
+
+static int sink_copy(void * ctx, uint32_t offset, uint32_t size)
+{
+    if ((offset > TEST_IMAGE_SIZE) || (size > TEST_IMAGE_SIZE - offset))
+    {
+        return 1;
+    }
+    return ota_sector_copy(&s_sink.sector, offset, size);
+}
+
+static int sink_decompressed(void * ctx, const uint8_t * data, size_t size)
+{
+    if (s_sink.encoding & OTA_ENC_DELTA)
+    {
+        return delta_decode(&s_sink.delta, data, size, sink_out, sink_copy, ctx);
+    }
+    return sink_out(ctx, data, size);
+}
+
+static void sink_write(const char * data, size_t size)
+{
+    const uint8_t * in = (const uint8_t *) data;
+    int r;
+
+    if (s_sink.encoding & OTA_ENC_LZSS)
+    {
+        r = lzss_decode(&s_sink.lzss, in, size, sink_decompressed, NULL);
+    }
+    else if (s_sink.encoding & OTA_ENC_DELTA)
+    {
+        r = delta_decode(&s_sink.delta, in, size, sink_out, sink_copy, NULL);
+    }
+    else
+    {
+        r = sink_out(NULL, in, size);
+    }
+    s_sink.error |= (OTA_DECODE_OK != r);
+}
+
+/**
+ * Same steps as ota_response_handler of ota.c.
+ * @return not 0 when download ends
+ */
+static int response_handler(const char * data, size_t length)
+{
+    uint64_t start = now_ns();
+    int end;
+
+    esp_ota_firm_parse_msg(&s_ota_firm, data, length);
+    s_parse_ns += now_ns() - start;
+
+    if (s_ota_firm.failed)
+    {
+        s_handler_ns += now_ns() - start;
+        return 1;
+    }
+    if (!s_sink.started && (ESP_OTA_INIT != s_ota_firm.state))
+    {
+        s_sink.started = true;
+        s_sink.offset = s_ota_firm.has_range ? s_ota_firm.range_start : 0;
+        s_sink.encoding = s_ota_firm.encoding;
+    }
+    if (esp_ota_firm_can_write(&s_ota_firm))
+    {
+        sink_write(esp_ota_firm_get_write_buf(&s_ota_firm), esp_ota_firm_get_write_bytes(&s_ota_firm));
+    }
+    end = esp_ota_firm_is_finished(&s_ota_firm) || s_sink.error;
+    if (esp_ota_firm_is_finished(&s_ota_firm))
+    {
+        s_sink.error |= (0 != ota_sector_flush(&s_sink.sector));
+    }
+    s_handler_ns += now_ns() - start;
+    return end;
+}
+
+/**
+ * Build response of given case.
+ * @return size, header size in header_len
+ */
+static size_t make_response(const Case_t * c, size_t * header_len)
+{
+    char extra[256];
+    size_t n;
+    size_t body_len;
+    const uint8_t * body = s_image;
+    uint8_t * file = NULL;
+
+    switch (c->body)
+    {
+    case BODY_DUAL:
+        body_len = 2 * TEST_IMAGE_SIZE;
+        break;
+    case BODY_RESUME:
+        body = &s_image[TEST_RESUME_AT];
+        body_len = TEST_IMAGE_SIZE - TEST_RESUME_AT;
+        break;
+    case BODY_FILE:
+        file = read_file(c->file, &body_len);
+        body = file;
+        break;
+    default:
+        body_len = TEST_IMAGE_SIZE;
+        break;
+    }
+
+    snprintf(extra, sizeof(extra), c->headers, TEST_SLOT);
+    n = snprintf(s_response, sizeof(s_response), "HTTP/1.1 %s\r\n"
+            /* longer than OTA_LINE_MAX, must be skipped */
+            "Server: test-server-with-very-long-name-that-does-not-fit-into-line-buffer-of-parser-%0*d\r\n"
+            "Content-Length: %u\r\n%s", (BODY_RESUME == c->body) ? "206 Partial Content" : "200 OK",
+            OTA_LINE_MAX, 0, (unsigned) body_len, extra);
+    if (BODY_RESUME == c->body)
+    {
+        n += snprintf(&s_response[n], sizeof(s_response) - n, "Content-Range: bytes %u-%u/%u\r\n",
+                TEST_RESUME_AT, TEST_IMAGE_SIZE - 1, TEST_IMAGE_SIZE);
+    }
+    n += snprintf(&s_response[n], sizeof(s_response) - n, "\r\n");
+    *header_len = n;
+
+    if (BODY_DUAL == c->body)
+    {
+        memcpy(&s_response[n], s_running, TEST_IMAGE_SIZE);
+        memcpy(&s_response[n + TEST_IMAGE_SIZE], s_image, TEST_IMAGE_SIZE);
+    }
+    else
+    {
+        memcpy(&s_response[n], body, body_len);
+    }
+    free(file);
+    return n + body_len;
+}
+
+/**
+ * Feed response in reads: first one of given size (0 - random too),
+ * then random ones up to max_read (fixed max_read if not random).
+ * @return true if result is as expected
+ */
+static bool run(const Case_t * c, size_t size, size_t first, size_t max_read, bool random)
+{
+    size_t pos = 0;
+    bool ok;
+
+    memset(s_partition, 0xFF, sizeof(s_partition));
+    if (BODY_RESUME == c->body)
+    {
+        memcpy(s_partition, s_image, TEST_RESUME_AT);
+    }
+    memset(&s_sink, 0, sizeof(s_sink));
+    lzss_init(&s_sink.lzss);
+    delta_init(&s_sink.delta);
+    ota_sector_init(&s_sink.sector, s_sink.buffer, partition_flash, running_read, NULL);
+    esp_ota_firm_init(&s_ota_firm, 2, TEST_SLOT);
+
+    while (pos < size)
+    {
+        size_t n = first ? first : (random ? 1 + rand() % max_read : max_read);
+
+        first = 0;
+        if (n > size - pos)
+        {
+            n = size - pos;
+        }
+        pos += n;
+        if (response_handler(&s_response[pos - n], n))
+        {
+            break;
+        }
+    }
+
+    if (c->fails)
+    {
+        return s_ota_firm.failed && !s_sink.offset;
+    }
+
+    /* only last write can be shorter than sector */
+    ok = !s_ota_firm.failed && !s_sink.error && esp_ota_firm_is_finished(&s_ota_firm)
+            && (s_sink.offset == TEST_IMAGE_SIZE) && !memcmp(s_partition, s_image, TEST_IMAGE_SIZE)
+            && (s_sink.partial <= 1);
+    for (size_t i = TEST_IMAGE_SIZE; ok && (i < sizeof(s_partition)); ++i)
+    {
+        ok = (0xFF == s_partition[i]);
+    }
+    if ((BODY_RESUME == c->body) && ((TEST_RESUME_AT != s_ota_firm.range_start) || (7 != s_ota_firm.image_id)))
+    {
+        ok = false;
+    }
+    return ok;
+}
+
+static int check_case(const Case_t * c)
+{
+    size_t header_len;
+    size_t size = make_response(c, &header_len);
+    int failed = 0;
+    int runs = 0;
+
+    /* every split of header, and of first bytes of body */
+    for (size_t split = 1; split <= header_len + 16; ++split, ++runs)
+    {
+        if (!run(c, size, split, TEST_READ_MAX, false))
+        {
+            printf("  %s: header split at %u failed\n", c->name, (unsigned) split);
+            ++failed;
+        }
+    }
+    for (size_t r = 0; r < sizeof(s_max_reads) / sizeof(s_max_reads[0]); ++r)
+    {
+        for (int i = 0; i < TEST_RUNS; ++i, ++runs)
+        {
+            if (!run(c, size, 0, s_max_reads[r], true))
+            {
+                printf("  %s: random reads up to %u failed\n", c->name, s_max_reads[r]);
+                ++failed;
+            }
+        }
+    }
+
+    /* cost of parsing (per KB of response) and of decoding and staging
+     * (per KB of image) with full reads, fake flash excluded */
+    s_parse_ns = 0;
+    s_handler_ns = 0;
+    s_flash_ns = 0;
+    failed += !run(c, size, 0, TEST_READ_MAX, false);
+
+    printf("OP %-13s %s %3d runs, %6u B response, %2u writes, parse %4u ns/KB, decode+stage %5u ns/KB\n",
+            c->name, failed ? "FAIL" : "OK  ", runs + 1, (unsigned) size, s_sink.writes,
+            (unsigned) (s_parse_ns * 1024 / size),
+            (unsigned) (s_sink.written ? (s_handler_ns - s_parse_ns - s_flash_ns) * 1024 / s_sink.written : 0));
+    return failed;
+}
+
+int main(int argc, char ** argv)
+{
+    size_t size;
+    int failed = 0;
+
+    if ((4 == argc) && !strcmp(argv[1], "gen"))
+    {
+        generate(argv[2], argv[3]);
+        return 0;
+    }
+    if ((4 != argc) || strcmp(argv[1], "check"))
+    {
+        printf("usage: %s gen|check <running.bin> <new.bin>\n", argv[0]);
+        return 2;
+    }
+
+    s_running = read_file(argv[2], &size);
+    s_image = read_file(argv[3], &s_image_size);
+    if ((TEST_IMAGE_SIZE != size) || (TEST_IMAGE_SIZE != s_image_size))
+    {
+        printf("images must have %u B\n", TEST_IMAGE_SIZE);
+        return 2;
+    }
+
+    srand(4);
+    for (size_t c = 0; c < sizeof(s_cases) / sizeof(s_cases[0]); ++c)
+    {
+        failed += check_case(&s_cases[c]);
+    }
+    printf("OP %d runs failed\n", failed);
+
+    free(s_running);
+    free(s_image);
+    return failed != 0;
+}
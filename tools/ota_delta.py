@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+#
+# Encoder of OTA images: binary delta against image running on device
+# and/or LZSS compression in heatshrink format (-w 10 -l 4), as decoded
+# by main/ota_decode.c. Server sends the output with "X-Ota-Encoding"
+# header of value printed by this script.
+#
+# usage: ota_delta.py [-b <running.bin>] [-z] [--heatshrink <path>] <new.bin> <out.bin>
+#
+#   -b  make delta of new image against running one
+#   -z  compress (delta or whole image); heatshrink program is used when
+#       found (on PATH or given), built-in encoder of the same format
+#       otherwise
+#
+
+from __future__ import print_function
+
+import argparse
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+# must match LZSS_WINDOW_BITS / LZSS_LOOKAHEAD_BITS of ota_decode.h
+LZSS_WINDOW_BITS = 10
+LZSS_LOOKAHEAD_BITS = 4
+# back-reference (15 bits) pays off from two bytes on (18 bits as literals)
+LZSS_MIN_MATCH = 2
+# candidates checked for each position, more - better and slower
+LZSS_CHAIN = 32
+
+# must match DELTA_OP_* of ota_decode.h
+DELTA_OP_COPY = b'C'
+DELTA_OP_LITERAL = b'L'
+# copy operation (9 bytes) pays off from that length on
+DELTA_MIN_MATCH = 16
+
+
+class BitWriter(object):
+    def __init__(self):
+        self.out = bytearray()
+        self.acc = 0
+        self.count = 0
+
+    def put(self, value, bits):
+        self.acc = (self.acc << bits) | value
+        self.count += bits
+        while self.count >= 8:
+            self.count -= 8
+            self.out.append((self.acc >> self.count) & 0xff)
+        self.acc &= (1 << self.count) - 1
+
+    def finish(self):
+        if self.count:
+            self.out.append((self.acc << (8 - self.count)) & 0xff)
+            self.count = 0
+        return bytes(self.out)
+
+
+def lzss_builtin(data):
+    """Greedy LZSS in heatshrink bit format: 1 + byte for literal,
+    0 + (distance - 1) + (length - 1) for back-reference."""
+    window = 1 << LZSS_WINDOW_BITS
+    longest = 1 << LZSS_LOOKAHEAD_BITS
+    w = BitWriter()
+    chains = {}
+    i = 0
+
+    while i < len(data):
+        best_len = 0
+        best_dist = 0
+        for j in reversed(chains.get(data[i:i + LZSS_MIN_MATCH], [])[-LZSS_CHAIN:]):
+            dist = i - j
+            if dist > window:
+                break
+            n = 0
+            while n < longest and i + n < len(data) and data[j + n] == data[i + n]:
+                n += 1
+            if n > best_len:
+                best_len, best_dist = n, dist
+                if n == longest:
+                    break
+
+        if best_len >= LZSS_MIN_MATCH:
+            w.put(0, 1)
+            w.put(best_dist - 1, LZSS_WINDOW_BITS)
+            w.put(best_len - 1, LZSS_LOOKAHEAD_BITS)
+            step = best_len
+        else:
+            w.put(1, 1)
+            w.put(data[i], 8)
+            step = 1
+
+        for k in range(i, i + step):
+            chain = chains.setdefault(data[k:k + LZSS_MIN_MATCH], [])
+            chain.append(k)
+            if len(chain) > 2 * LZSS_CHAIN:
+                del chain[:LZSS_CHAIN]
+        i += step
+
+    return w.finish()
+
+
+def lzss(data, heatshrink=None):
+    """Compress with heatshrink program if available, built-in encoder otherwise."""
+    program = heatshrink or shutil.which('heatshrink')
+    if not program:
+        return lzss_builtin(data)
+
+    with tempfile.NamedTemporaryFile(delete=False) as f:
+        f.write(data)
+        name = f.name
+    try:
+        return subprocess.check_output([program, '-e', '-w', str(LZSS_WINDOW_BITS),
+                '-l', str(LZSS_LOOKAHEAD_BITS), name])
+    finally:
+        os.unlink(name)
+
+
+def delta(base, new):
+    """Copy operations for runs (DELTA_MIN_MATCH or longer) found
+    in base image, literal operations for the rest."""
+    out = bytearray()
+    literal = bytearray()
+    index = {}
+    i = 0
+
+    for k in range(len(base) - DELTA_MIN_MATCH + 1):
+        index.setdefault(base[k:k + DELTA_MIN_MATCH], k)
+
+    def flush():
+        if literal:
+            out.extend(DELTA_OP_LITERAL + struct.pack('<I', len(literal)) + literal)
+            del literal[:]
+
+    while i < len(new):
+        k = index.get(new[i:i + DELTA_MIN_MATCH])
+        if k is None:
+            literal.append(new[i])
+            i += 1
+            continue
+
+        n = DELTA_MIN_MATCH
+        while i + n < len(new) and k + n < len(base) and base[k + n] == new[i + n]:
+            n += 1
+        flush()
+        out.extend(DELTA_OP_COPY + struct.pack('<II', k, n))
+        i += n
+
+    flush()
+    return bytes(out)
+
+
+def encode(new, base=None, compress=False, heatshrink=None):
+    """Encoded image and value of X-Ota-Encoding header for it."""
+    encoding = []
+    body = new
+    if base is not None:
+        body = delta(base, body)
+        encoding.append('delta')
+    if compress:
+        body = lzss(body, heatshrink)
+        encoding.append('lzss')
+    return body, ','.join(encoding)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Encode OTA image for X-Ota-Encoding download.')
+    parser.add_argument('-b', '--base', help='image running on device, makes delta')
+    parser.add_argument('-z', '--lzss', action='store_true', help='compress')
+    parser.add_argument('--heatshrink', help='heatshrink program')
+    parser.add_argument('new')
+    parser.add_argument('out')
+    args = parser.parse_args()
+
+    if args.base is None and not args.lzss:
+        print('nothing to do, give -b and/or -z')
+        return 2
+
+    with open(args.new, 'rb') as f:
+        new = f.read()
+    base = None
+    if args.base:
+        with open(args.base, 'rb') as f:
+            base = f.read()
+
+    body, encoding = encode(new, base, args.lzss, args.heatshrink)
+    with open(args.out, 'wb') as f:
+        f.write(body)
+
+    print('%s: %d -> %d bytes (%d%%), X-Ota-Encoding: %s' % (args.out, len(new), len(body),
+            100 * len(body) // max(len(new), 1), encoding))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+#
+# Minimal server of OTA images for device (GET /ota, see "Firmware
+# update" in README). Sends only image of requested slot, with:
+#   X-Ota-Slot      - the slot
+#   X-Ota-Image     - identifier of image, for resuming download
+#   X-Ota-Crc32     - CRC32 of whole image
+#   X-Ota-Encoding  - when image is sent encoded (tools/ota_delta.py)
+# and answers "Range: bytes=<offset>-" of resumed download with 206 and
+# Content-Range, when image=<id> of request is still the current one.
+#
+# usage: ota_server.py [-p <port>] [-z] [--running0 <bin>] [--running1 <bin>]
+#                      [--dual] <app0.bin> [<app1.bin>]
+#
+#   appN.bin     new image linked for slot N
+#   -z           send images compressed (lzss) when device accepts it
+#   --runningN   image device runs from slot N, deltas are made against it
+#   --dual       old server behaviour: all images one after another,
+#                without X-Ota-Slot
+#
+
+import argparse
+import os
+import re
+import sys
+import zlib
+
+from http.server import BaseHTTPRequestHandler, HTTPServer
+from urllib.parse import parse_qs, urlparse
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import ota_delta  # noqa: E402
+
+RANGE = re.compile(r'^bytes=(\d+)-$')
+
+
+class Images(object):
+    def __init__(self, args):
+        self.images = []
+        for name in args.images:
+            with open(name, 'rb') as f:
+                self.images.append(f.read())
+        self.running = {}
+        for slot, name in ((0, args.running0), (1, args.running1)):
+            if name:
+                with open(name, 'rb') as f:
+                    self.running[slot] = f.read()
+        self.compress = args.lzss
+        self.heatshrink = args.heatshrink
+        self.dual = args.dual
+        self.encoded = {}
+
+    @staticmethod
+    def image_id(image):
+        """Identifier of image, not 0 (0 - no identifier)."""
+        return (zlib.crc32(image) & 0x7fffffff) or 1
+
+    def encode(self, slot, accepted):
+        """Smallest encoding of slot image device accepts,
+        (None, '') when raw image is the best."""
+        # device updates the other slot than it runs from
+        base = self.running.get(1 - slot) if 'delta' in accepted else None
+        compress = self.compress and 'lzss' in accepted
+        if base is None and not compress:
+            return None, ''
+
+        key = (slot, base is not None, compress)
+        if key not in self.encoded:
+            self.encoded[key] = ota_delta.encode(self.images[slot], base, compress, self.heatshrink)
+        body, encoding = self.encoded[key]
+        if len(body) >= len(self.images[slot]):
+            return None, ''
+        return body, encoding
+
+
+class Handler(BaseHTTPRequestHandler):
+    images = None
+
+    def do_GET(self):
+        url = urlparse(self.path)
+        query = parse_qs(url.query)
+        if url.path != '/ota':
+            self.send_error(404)
+            return
+
+        images = self.images
+        slot = query.get('slot', [None])[0]
+        if images.dual or slot is None:
+            self.send_body(200, b''.join(images.images), [])
+            return
+
+        slot = int(slot)
+        if slot >= len(images.images):
+            self.send_error(404, 'no image for slot %d' % slot)
+            return
+
+        image = images.images[slot]
+        image_id = images.image_id(image)
+        headers = [('X-Ota-Slot', str(slot)), ('X-Ota-Image', str(image_id)),
+                   ('X-Ota-Crc32', '%08x' % (zlib.crc32(image) & 0xffffffff))]
+
+        m = RANGE.match(self.headers.get('Range', ''))
+        if m and query.get('image', [''])[0] == str(image_id) and 0 < int(m.group(1)) < len(image):
+            # rest of interrupted download, always raw
+            start = int(m.group(1))
+            headers.append(('Content-Range', 'bytes %d-%d/%d' % (start, len(image) - 1, len(image))))
+            self.send_body(206, image[start:], headers)
+            return
+
+        body, encoding = images.encode(slot, query.get('enc', [''])[0].split(','))
+        if body is None:
+            body = image
+        else:
+            headers.append(('X-Ota-Encoding', encoding))
+        self.send_body(200, body, headers)
+
+    def send_body(self, status, body, headers):
+        self.send_response(status)
+        self.send_header('Content-Type', 'application/octet-stream')
+        self.send_header('Content-Length', str(len(body)))
+        for name, value in headers:
+            self.send_header(name, value)
+        self.end_headers()
+        self.wfile.write(body)
+        self.log_message('sent %d B%s', len(body), ''.join(', %s: %s' % h for h in headers))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Serve OTA images to device.')
+    parser.add_argument('-p', '--port', type=int, default=8080)
+    parser.add_argument('-z', '--lzss', action='store_true', help='compress images')
+    parser.add_argument('--heatshrink', help='heatshrink program')
+    parser.add_argument('--running0', help='image running in slot 0 (base of delta for slot 1)')
+    parser.add_argument('--running1', help='image running in slot 1 (base of delta for slot 0)')
+    parser.add_argument('--dual', action='store_true', help='send all images, ignore slot')
+    parser.add_argument('images', nargs='+', help='new image for slot 0, 1')
+    args = parser.parse_args()
+
+    Handler.images = Images(args)
+    server = HTTPServer(('', args.port), Handler)
+    print('serving %d image(s) on port %d' % (len(args.images), args.port))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,160 @@
+#!/usr/bin/env python
+#
+# Per-module size report of linked application, checked against budgets.
+# Sizes are taken from linker map, so only code that made it into the
+# image (after --gc-sections) is counted.
+#
+# usage: size_budget.py <app.map> <app.bin> <budget file>
+#
+# Budget file lines: <name> <flash> <ram>
+#   name  - source of main component (client.c), library (libfoo.a),
+#           "main" (whole main component) or "image" (application binary)
+#   flash - limit of text + rodata + data [B]
+#   ram   - limit of data + bss [B] (ignored for image)
+#   "-" in place of limit - not checked
+#
+
+from __future__ import print_function
+
+import os
+import re
+import sys
+
+MAIN_ARCHIVE = 'libmain.a'
+
+SECTION_LINE = re.compile(r'^ (\.\S+|COMMON)(?:\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S+))?\s*$')
+ADDRESS_LINE = re.compile(r'^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S+)\s*$')
+OBJECT_NAME = re.compile(r'([^/\\]+\.a)\(([^)]+)\)$')
+
+
+def section_class(name):
+    """Kind of memory section goes to, None if not part of image."""
+    if name.startswith(('.debug', '.comment', '.xt.', '.xtensa', '.note')):
+        return None
+    if name.startswith(('.text', '.literal', '.irom', '.iram', '.fini', '.init')):
+        return 'text'
+    if name.startswith('.rodata'):
+        return 'rodata'
+    if name.startswith(('.data', '.sdata', '.dram')):
+        return 'data'
+    if name.startswith(('.bss', '.sbss', 'COMMON')):
+        return 'bss'
+    return None
+
+
+def module_name(path):
+    """Source of main component or library object comes from,
+    and if it is part of main component."""
+    m = OBJECT_NAME.search(path)
+    if not m:
+        return os.path.basename(path), False
+    archive, obj = m.groups()
+    if archive == MAIN_ARCHIVE:
+        return os.path.splitext(obj)[0] + '.c', True
+    return archive, False
+
+
+def read_map(map_path):
+    sizes = {}
+    pending = None
+
+    with open(map_path) as f:
+        lines = iter(f)
+        for line in lines:
+            if line.startswith('Linker script and memory map'):
+                break
+
+        for line in lines:
+            entry = None
+            m = SECTION_LINE.match(line)
+            if m:
+                if m.group(4):
+                    entry = (m.group(1), int(m.group(2), 16), int(m.group(3), 16), m.group(4))
+                    pending = None
+                else:
+                    pending = m.group(1)
+            elif pending:
+                m = ADDRESS_LINE.match(line)
+                if m:
+                    entry = (pending, int(m.group(1), 16), int(m.group(2), 16), m.group(3))
+                pending = None
+
+            if not entry:
+                continue
+
+            name, address, size, path = entry
+            kind = section_class(name)
+            if kind is None or address == 0 or size == 0:
+                continue
+
+            module, is_main = module_name(path)
+            module = sizes.setdefault(module, {'text': 0, 'rodata': 0, 'data': 0, 'bss': 0, 'main': is_main})
+            module[kind] += size
+
+    return sizes
+
+
+def read_limit(text):
+    """Limit in bytes, None if not checked ("-")."""
+    return None if text == '-' else int(text, 0)
+
+
+def format_limit(limit):
+    return '-' if limit is None else '%d' % limit
+
+
+def read_budget(budget_path):
+    budget = {}
+    with open(budget_path) as f:
+        for line in f:
+            line = line.split('#')[0].split()
+            if len(line) == 3:
+                budget[line[0]] = (read_limit(line[1]), read_limit(line[2]))
+    return budget
+
+
+def check(name, flash, ram, budget, failures):
+    limit = budget.get(name)
+    mark = ''
+    if limit:
+        if ((limit[0] is not None and flash > limit[0])
+                or (name != 'image' and limit[1] is not None and ram > limit[1])):
+            mark = ' OVER BUDGET'
+            failures.append(name)
+        mark = ' (budget %s / %s)%s' % (format_limit(limit[0]), format_limit(limit[1]), mark)
+    return mark
+
+
+def main():
+    if len(sys.argv) != 4:
+        print('usage: size_budget.py <app.map> <app.bin> <budget file>')
+        return 2
+
+    sizes = read_map(sys.argv[1])
+    image = os.path.getsize(sys.argv[2])
+    budget = read_budget(sys.argv[3])
+    failures = []
+    total = {'text': 0, 'rodata': 0, 'data': 0, 'bss': 0}
+
+    print('%-20s %8s %8s %8s %8s' % ('module', 'text', 'rodata', 'data', 'bss'))
+    for name in sorted(sizes, key=lambda n: (not sizes[n]['main'], n)):
+        s = sizes[name]
+        if s['main']:
+            for k in total:
+                total[k] += s[k]
+        print('%-20s %8d %8d %8d %8d%s' % (name, s['text'], s['rodata'], s['data'], s['bss'],
+                check(name, s['text'] + s['rodata'] + s['data'], s['data'] + s['bss'], budget, failures)))
+
+    print('%-20s %8d %8d %8d %8d%s' % ('main', total['text'], total['rodata'], total['data'], total['bss'],
+            check('main', total['text'] + total['rodata'] + total['data'], total['data'] + total['bss'],
+                budget, failures)))
+    print('%-20s %8d%s' % ('image', image, check('image', image, 0, budget, failures)))
+
+    if failures:
+        print('Size budget exceeded: %s' % ', '.join(failures))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())